@@ -0,0 +1,81 @@
+// Edge cases of the 16-bit log-weight encoding of CompactEventWeights, and
+// rows of different lengths within one event and one run table
+
+#include "ubsim/EventWeight/Products/CompactEventWeight.h"
+
+#include "cetlib_except/exception.h"
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace {
+
+  int failures = 0;
+
+  void check(bool ok, const char* what)
+  {
+    if (!ok) {
+      std::cerr << "FAILED: " << what << '\n';
+      ++failures;
+    }
+  }
+
+}
+
+int main()
+{
+  double const step = 1.e-3;
+  unsigned short const max_code = std::numeric_limits<unsigned short>::max();
+  double const inf = std::numeric_limits<double>::infinity();
+
+  check(evwgh::EncodeLog16(0., step) == 0, "zero weight encodes to code 0");
+  check(evwgh::DecodeLog16(0, step) == 0., "code 0 decodes to zero");
+  check(evwgh::EncodeLog16(-1., step) == 0, "negative weight encodes to code 0");
+  check(evwgh::EncodeLog16(-inf, step) == 0, "-inf encodes to code 0");
+
+  check(evwgh::EncodeLog16(inf, step) == max_code, "+inf saturates");
+  check(evwgh::EncodeLog16(std::numeric_limits<double>::quiet_NaN(), step) == max_code, "NaN saturates");
+  check(evwgh::EncodeLog16(std::numeric_limits<double>::max(), step) == max_code, "huge weight saturates");
+  check(evwgh::EncodeLog16(1.e300, 1.e-300) == max_code, "log/step beyond the range of long saturates");
+
+  check(evwgh::EncodeLog16(std::numeric_limits<double>::denorm_min(), step) == 1, "tiny weight clamps to code 1");
+  check(evwgh::EncodeLog16(1.e-300, 1.e-300) == 1, "-log/step beyond the range of long clamps to code 1");
+
+  for (double w : {1., 0.5, 2., 1.e-5, 1.e5}) {
+    double const back = evwgh::DecodeLog16(evwgh::EncodeLog16(w, step), step);
+    check(std::abs(std::log(back / w)) <= 0.5 * step + 1.e-12, "round trip within half a step");
+  }
+
+  // Function "b" is absent from the first MCTruth and longer in the second
+  evwgh::CompactWeightTable table;
+  check(table.Add("a") == 0 && table.Add("b") == 1 && table.Add("a") == 0, "table numbering");
+
+  evwgh::CompactEventWeights weights;
+  weights.fNTruths = 2;
+  weights.fNFunctions = 2;
+  weights.fSizes = {2, 0, 1, 3};
+  weights.fFloat = {1.f, 2.f, 3.f, 4.f, 5.f, 6.f};
+
+  auto const first = evwgh::ExpandWeights(table, weights, 0);
+  check(first.at("a") == std::vector<double>{1., 2.} && first.at("b").empty(), "first MCTruth");
+  auto const second = evwgh::ExpandWeights(table, weights, 1);
+  check(second.at("a") == std::vector<double>{3.} &&
+        second.at("b") == std::vector<double>{4., 5., 6.}, "second MCTruth");
+
+  // A fragment that saw fewer functions merges into the longer table
+  evwgh::CompactWeightTable early;
+  early.Add("a");
+  early.aggregate(table);
+  check(early.fNames == table.fNames, "aggregate keeps the longer name list");
+
+  evwgh::CompactWeightTable other;
+  other.Add("b");
+  bool threw = false;
+  try { other.aggregate(table); }
+  catch (cet::exception const&) { threw = true; }
+  check(threw, "aggregate rejects tables with different numbering");
+
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////
+// Class:       EventWeightTestTruth
+// Plugin Type: producer
+// File:        EventWeightTestTruth_module.cc
+//
+// Writes a fixed set of beam neutrinos for the weight calculator tests:
+// event i holds one MCTruth/MCFlux pair per entry of Events[i % size],
+// each entry being the PDG code of the neutrino's parent hadron. Every
+// neutrino is a 1 GeV numu (numubar for a negative parent) along the beam.
+////////////////////////////////////////////////////////////////////////
+
+#include "art/Framework/Core/EDProducer.h"
+#include "art/Framework/Core/ModuleMacros.h"
+#include "art/Framework/Principal/Event.h"
+#include "cetlib_except/exception.h"
+#include "fhiclcpp/ParameterSet.h"
+
+#include "nusimdata/SimulationBase/MCFlux.h"
+#include "nusimdata/SimulationBase/MCTruth.h"
+
+#include "TLorentzVector.h"
+
+#include <memory>
+#include <vector>
+
+class EventWeightTestTruth : public art::EDProducer {
+public:
+  explicit EventWeightTestTruth(fhicl::ParameterSet const& p);
+
+  void produce(art::Event& e) override;
+
+private:
+  std::vector<std::vector<int>> fEvents; // parent hadron PDG codes, per event
+  size_t fNEvents = 0;
+};
+
+
+EventWeightTestTruth::EventWeightTestTruth(fhicl::ParameterSet const& p)
+  : EDProducer{p},
+  fEvents{p.get<std::vector<std::vector<int>>>("Events")}
+{
+  if (fEvents.empty()) {
+    throw cet::exception("EventWeightTestTruth") << "Events must not be empty\n";
+  }
+
+  produces< std::vector<simb::MCTruth> >();
+  produces< std::vector<simb::MCFlux> >();
+}
+
+
+void EventWeightTestTruth::produce(art::Event& e)
+{
+  auto truthcol = std::make_unique<std::vector<simb::MCTruth>>();
+  auto fluxcol = std::make_unique<std::vector<simb::MCFlux>>();
+
+  for (int parent : fEvents[fNEvents++ % fEvents.size()]) {
+    int const nu_pdg = (parent > 0 ? 14 : -14);
+
+    simb::MCParticle nu(0, nu_pdg, "primary", -1, 0., 0);
+    nu.AddTrajectoryPoint(TLorentzVector(0., 0., 0., 0.), TLorentzVector(0., 0., 1., 1.));
+
+    simb::MCTruth truth;
+    truth.Add(nu);
+    truth.SetOrigin(simb::kBeamNeutrino);
+    truthcol->push_back(truth);
+
+    // parent hadron leaving the target at 3 GeV/c, 20 mrad off axis
+    simb::MCFlux flux;
+    flux.fntype = nu_pdg;
+    flux.fnenergy = 1.;
+    flux.fptype = parent;
+    flux.ftptype = parent;
+    flux.ftpx = 0.06;
+    flux.ftpy = 0.;
+    flux.ftpz = 3.;
+    fluxcol->push_back(flux);
+  }
+
+  e.put(std::move(truthcol));
+  e.put(std::move(fluxcol));
+}
+
+DEFINE_ART_MODULE(EventWeightTestTruth)
@@ -0,0 +1,83 @@
+// The SIMD block statistics kernel selected by ComputeBlockStats against the
+// scalar reference, on random waveforms and on block lengths that are 0, 1 or
+// not a multiple of the vector width
+
+#include "ubsim/SNStreamSim/Algo/BlockStatistics.h"
+
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+  int failures = 0;
+
+  void check(bool ok, const std::string& what)
+  {
+    if (!ok) {
+      std::cerr << "FAILED: " << what << '\n';
+      ++failures;
+    }
+  }
+
+  void compare(const std::vector<short>& waveform, size_t first, size_t stride, size_t nblocks,
+	       int block, int maxADC)
+  {
+    std::vector<compress::BlockStats> simd(nblocks + 1, {-1, -1});
+    std::vector<compress::BlockStats> scalar(nblocks + 1, {-1, -1});
+    compress::ComputeBlockStats(waveform.data(), first, stride, nblocks, block, maxADC, simd.data());
+    compress::ComputeBlockStatsScalar(waveform.data(), first, stride, nblocks, block, maxADC, scalar.data());
+
+    for (size_t k = 0; k <= nblocks; k++) {
+      if (simd[k].baseline == scalar[k].baseline && simd[k].variance == scalar[k].variance) continue;
+      std::ostringstream what;
+      what << "block " << k << " of " << nblocks << " (length " << block << ", first " << first
+	   << ", stride " << stride << ", maxADC " << maxADC << "): SIMD "
+	   << simd[k].baseline << '/' << simd[k].variance << ", scalar "
+	   << scalar[k].baseline << '/' << scalar[k].variance;
+      check(false, what.str());
+      return;
+    }
+  }
+
+}
+
+int main()
+{
+  std::mt19937 rng(20261018);
+  std::uniform_int_distribution<int> noisy(-2048, 4095);
+  std::normal_distribution<double> quiet(2048., 3.);
+
+  std::vector<short> waveform(9600);
+
+  // full-range noise, and a quiet baseline where the clamp rarely applies
+  for (int pass = 0; pass < 2; pass++) {
+    for (auto& adc : waveform)
+      adc = (pass == 0 ? noisy(rng) : static_cast<short>(quiet(rng)));
+
+    for (int block : {0, 1, 2, 7, 8, 9, 15, 16, 17, 31, 33, 63, 64, 65, 100, 128}) {
+      for (int maxADC : {0, 1, 60, 1 << 20, 1 << 30}) {
+	for (size_t first : {0, 1, 3}) {
+	  const size_t stride = (block > 1 ? block - 1 : 1);
+	  const size_t nblocks = (waveform.size() - first - block) / stride;
+	  compare(waveform, first, stride, 0, block, maxADC);
+	  compare(waveform, first, stride, 1, block, maxADC);
+	  compare(waveform, first, stride, nblocks, block, maxADC);
+	}
+      }
+    }
+  }
+
+  // constant waveforms: the variance is zero and the baseline exact for 64-tick blocks
+  for (short value : {0, 1, -1, 4095}) {
+    std::vector<short> flat(640, value);
+    std::vector<compress::BlockStats> stats(10);
+    compress::ComputeBlockStats(flat.data(), 0, 64, 10, 64, 60, stats.data());
+    bool ok = true;
+    for (auto const& s : stats) ok = ok && s.baseline == value && s.variance == 0;
+    check(ok, "flat waveform of " + std::to_string(value));
+  }
+
+  return (failures == 0 ? 0 : 1);
+}
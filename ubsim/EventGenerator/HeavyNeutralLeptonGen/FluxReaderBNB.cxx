@@ -30,6 +30,11 @@ hpsgen::FluxReaderBNB::FluxReaderBNB(fhicl::ParameterSet const& p, CLHEP::HepRan
 hpsgen::FluxReaderBNB::~FluxReaderBNB() {
 }
 
+// charged kaon decays, as selected by get_kaon_from_flux before its two body check
+const char* hpsgen::FluxReaderBNB::preselection() const {
+  return "npart > 1 && id[1] >= 11 && id[1] <= 12";
+}
+
 bool hpsgen::FluxReaderBNB::get_kaon_from_flux(TLorentzVector& kmom, TLorentzVector& kpos, int& kpdg, int& pi_type, double& weight) {
 
   //pain in ze a to do this but need to calc engs to check if kaon decays are two or 3 body
@@ -26,6 +26,11 @@ hpsgen::FluxReaderNuMI::~FluxReaderNuMI() {
   if(dk2nu) delete dk2nu;
 }
 
+// charged kaon two body decays, as selected by get_kaon_from_flux
+const char* hpsgen::FluxReaderNuMI::preselection() const {
+  return "decay.ndecay == 5 || decay.ndecay == 8";
+}
+
 bool hpsgen::FluxReaderNuMI::get_kaon_from_flux(TLorentzVector& kmom, TLorentzVector& kpos, int& kpdg, int& pi_type, double& weight) {
 
   
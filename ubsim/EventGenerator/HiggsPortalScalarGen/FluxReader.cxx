@@ -3,16 +3,117 @@
 #include "TFile.h"
 #include "TChain.h"
 #include "TH1D.h"
+#include "TROOT.h"
+#include "TTreeFormula.h"
 
 #include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <thread>
 #include <glob.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "CLHEP/Random/RandFlat.h"
 
 #include "art/Framework/Services/Registry/ServiceHandle.h"
 #include "ifdh_art/IFDHService/IFDH_service.h"
 
+namespace {
+  struct pot_count {
+    long long entries; // in the flux tree
+    double pot;
+  };
+
+  // size and modification time of a local file
+  bool file_id(const std::string& path, long long& size, long long& mtime) {
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0) return false;
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+  }
+
+  // same sum as TTree::Draw("1", bname) followed by adding up TTree::GetW()
+  pot_count count_file_pot(const std::string& fname, const char* tree_name, const char* bname, const char* tname) {
+    std::unique_ptr<TFile> f(TFile::Open(fname.c_str()));
+    if(!f || f->IsZombie()) {
+      throw cet::exception("Configuration") << "cannot open flux file "<<fname<<std::endl;
+    }
+    TTree *t = (TTree*)f->Get(tname);
+    if(!t) {
+      throw cet::exception("Configuration") << "cannot read pot counting tree in flux files";
+    }
+    TTreeFormula formula("pot", bname, t);
+    double pot = 0.;
+    for(Long64_t i = 0; i < t->GetEntries(); ++i) {
+      t->LoadTree(i);
+      const int ndata = formula.GetNdata();
+      for(int j = 0; j < ndata; ++j) pot += formula.EvalInstance(j);
+    }
+    TTree *flux = (TTree*)f->Get(tree_name);
+    return { flux ? flux->GetEntries() : 0ll, pot };
+  }
+
+  bool passes(TTreeFormula& formula) {
+    return formula.GetNdata() > 0 && formula.EvalInstance(0) != 0.;
+  }
+
+  // one line per flux file: path, size, mtime, flux tree, pot branch, pot tree, entries, pot (tab separated)
+  std::map<std::string, pot_count> read_pot_index(const std::string& fname) {
+    std::map<std::string, pot_count> index;
+    std::ifstream in(fname);
+    std::string line;
+    while(std::getline(in, line)) {
+      if(line.empty() || line[0] == '#') continue;
+      const size_t pot_pos = line.rfind('\t');
+      if(pot_pos == std::string::npos || pot_pos == 0) continue;
+      const size_t entries_pos = line.rfind('\t', pot_pos - 1);
+      if(entries_pos == std::string::npos) continue;
+      try {
+        index[line.substr(0, entries_pos)] = { std::stoll(line.substr(entries_pos + 1, pot_pos - entries_pos - 1)), std::stod(line.substr(pot_pos + 1)) };
+      }
+      catch(const std::exception&) {
+        continue;
+      }
+    }
+    return index;
+  }
+
+  // written to a temporary file first, so concurrent jobs never see a partial index
+  void write_pot_index(const std::string& fname, const std::map<std::string, pot_count>& index) {
+    const std::string tmp_name = fname + ".tmp." + std::to_string(getpid());
+    {
+      std::ofstream out(tmp_name);
+      out << "# hpsgen::FluxReader POT index: path, size, mtime, flux tree, pot branch, pot tree, flux entries, pot\n";
+      out << std::setprecision(std::numeric_limits<double>::max_digits10);
+      for(auto const& i : index) {
+        out << i.first << '\t' << i.second.entries << '\t' << i.second.pot << '\n';
+      }
+      if(!out) {
+        std::cout << "hpsgen::FluxReader::count_pot : cannot write pot index "<<tmp_name<<std::endl;
+        std::remove(tmp_name.c_str());
+        return;
+      }
+    }
+    if(std::rename(tmp_name.c_str(), fname.c_str()) != 0) {
+      std::cout << "hpsgen::FluxReader::count_pot : cannot write pot index "<<fname<<std::endl;
+      std::remove(tmp_name.c_str());
+    }
+  }
+}
+
 hpsgen::FluxReader::FluxReader(fhicl::ParameterSet const& p, CLHEP::HepRandomEngine& fRNG,
     const char* tree_name, const char* pot_branch_name, const char* pot_tree) : 
   fFluxLocation(p.get<std::string>("flux_location","")),
@@ -21,7 +122,12 @@ hpsgen::FluxReader::FluxReader(fhicl::ParameterSet const& p, CLHEP::HepRandomEng
   fFluxTree(new TChain(tree_name)),
   fCurrEntry(-1), fPOTperFluxFile{}, fTotalPOTinFluxFiles(0.), fEntriesPerFluxFile{}, fFullChainsSeen(0),
   fMaxFluxFileMB(p.get<unsigned int>("ifdh_max_size",1000)),
-  fCache{}, fSelectedEntries{}
+  fPOTIndexFile(p.get<std::string>("flux_pot_index","")),
+  fPOTThreads(p.get<unsigned int>("flux_pot_threads",8)),
+  fPrefetchDepth(p.get<unsigned int>("flux_prefetch_entries",10000)),
+  fTreeCacheMB(p.get<unsigned int>("flux_tree_cache_mb",50)),
+  fReadingSetUp(false), fPreselection{}, fPrefetch{},
+  fCurrent{}, fKaons{}, fCurrKaon(0)
 {
   if(fFluxLocation.empty()) {
     throw cet::exception("Configuration") << "must supply a flux file location";
@@ -33,9 +139,10 @@ hpsgen::FluxReader::FluxReader(fhicl::ParameterSet const& p, CLHEP::HepRandomEng
     throw cet::exception("Configuration") << "Can only use xrootd schema with files on /pnfs/";
   }
   
+  std::vector<flux_file> flux_files;
   if(fFluxAccessSchema == "direct" || fFluxAccessSchema == "xrootd") {
     glob_t glob_result;
-    std::map<double,std::string> filenames;
+    std::map<double,flux_file> filenames;
     int ret = glob(fFluxLocation.c_str(), GLOB_TILDE, NULL, &glob_result);
     if(ret != 0) {
       globfree(&glob_result);
@@ -65,6 +172,8 @@ hpsgen::FluxReader::FluxReader(fhicl::ParameterSet const& p, CLHEP::HepRandomEng
     else {
       for(size_t i = 0; i < glob_result.gl_pathc; ++i) {
         std::string fn = glob_result.gl_pathv[i];
+        flux_file ff{"", fn, -1, -1};
+        file_id(fn, ff.size, ff.mtime);
         if(fFluxAccessSchema == "xrootd") {
           if(fn.compare(0,6,"/pnfs/") == 0) {
             fn.replace(0,6,"root://fndca1.fnal.gov:1094/pnfs/fnal.gov/usr/");
@@ -75,12 +184,13 @@ hpsgen::FluxReader::FluxReader(fhicl::ParameterSet const& p, CLHEP::HepRandomEng
           }
         }
         // make a random ordering of the filenames
-        filenames[CLHEP::RandFlat::shoot(&fRNG)] = fn;
+        ff.name = fn;
+        filenames[CLHEP::RandFlat::shoot(&fRNG)] = ff;
       }
       globfree(&glob_result);
     }
     for(auto const& f : filenames) {
-      fFluxTree->Add(f.second.c_str());
+      flux_files.push_back(f.second);
     }
   }
   else if(fFluxAccessSchema == "ifdh") {
@@ -104,9 +214,17 @@ hpsgen::FluxReader::FluxReader(fhicl::ParameterSet const& p, CLHEP::HepRandomEng
       if(tot_size > max_size) break;
     }
     auto const& locals = ifdh->fetchSharedFiles(selected_list);
-    for(auto const& l : locals) {
+    for(size_t i = 0; i < locals.size(); ++i) {
+      auto const& l = locals[i];
       std::cout << "fetched "<<l.first<<std::endl;
-      fFluxTree->Add(l.first.c_str());
+      // local copies change from job to job, so index them by their source
+      flux_file ff{l.first, l.first, -1, -1};
+      if(locals.size() == selected_list.size()) {
+        ff.key = selected_list[i].first;
+        ff.size = selected_list[i].second;
+        ff.mtime = 0;
+      }
+      flux_files.push_back(ff);
     }
   }
   std::cout << "hpsgen::FluxReader::FluxReader : please wait, initializing flux (can take some time) ... "<<std::endl;
@@ -118,11 +236,11 @@ hpsgen::FluxReader::FluxReader(fhicl::ParameterSet const& p, CLHEP::HepRandomEng
     try {
 
       /* vvv this code is all that is needed, withouth error handling */
+      count_pot(flux_files, pot_branch_name, pot_tree);
       const unsigned long nentries = fFluxTree->GetEntries();
       if(nentries < 1) {
         throw cet::exception("Configuration") << "There are no flux entries."<<std::endl;
       }
-      count_pot(pot_branch_name, pot_tree);
       /* ^^^ end this code block */
 
       break;
@@ -160,7 +278,93 @@ hpsgen::FluxReader::FluxReader(fhicl::ParameterSet const& p, CLHEP::HepRandomEng
   }
 }
 
+// Runs the preselection on the flux entries ahead of the reader, in its own
+// thread and on its own chain over the same files, and queues the entries that
+// pass it. An entry of -1 marks the end of each pass over the chain.
+class hpsgen::FluxReader::prefetcher {
+  public:
+    prefetcher(const std::vector<std::string>& files, const std::vector<unsigned long>& entries,
+        const std::string& tree_name, const std::string& selection, bool loop, size_t depth, long long cache_size) :
+      fDepth(std::max<size_t>(depth, 1)), fStop(false),
+      fThread(&prefetcher::run, this, files, entries, tree_name, selection, loop, cache_size) {}
+
+    ~prefetcher() {
+      {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fStop = true;
+      }
+      fCond.notify_all();
+      fThread.join();
+    }
+
+    long next() {
+      std::unique_lock<std::mutex> lock(fMutex);
+      fCond.wait(lock, [this]() { return !fQueue.empty() || fError; });
+      if(fQueue.empty()) std::rethrow_exception(fError);
+      const long entry = fQueue.front();
+      fQueue.pop_front();
+      fCond.notify_all();
+      return entry;
+    }
+
+  private:
+    // false if the reader is gone
+    bool push(long entry) {
+      std::unique_lock<std::mutex> lock(fMutex);
+      fCond.wait(lock, [this]() { return fQueue.size() < fDepth || fStop; });
+      if(fStop) return false;
+      fQueue.push_back(entry);
+      fCond.notify_all();
+      return true;
+    }
+
+    void run(std::vector<std::string> files, std::vector<unsigned long> entries,
+        std::string tree_name, std::string selection, bool loop, long long cache_size) {
+      try {
+        TChain chain(tree_name.c_str());
+        for(size_t i = 0; i < files.size(); ++i) chain.Add(files[i].c_str(), entries[i]);
+        if(cache_size > 0) chain.SetCacheSize(cache_size);
+        const long nentries = chain.GetEntries();
+        chain.LoadTree(0);
+        TTreeFormula formula("preselection", selection.c_str(), &chain);
+        const bool use_formula = formula.GetNdim() > 0;
+        if(!use_formula) {
+          std::cout << "hpsgen::FluxReader : cannot use flux preselection '"<<selection<<"', reading every entry"<<std::endl;
+        }
+        chain.SetNotify(&formula);
+        bool reader_gone = false;
+        do {
+          for(long entry = 0; entry < nentries && !reader_gone; ++entry) {
+            if(chain.LoadTree(entry) < 0) {
+              throw cet::exception("LogicError") << "cannot read flux entry "<<entry<<std::endl;
+            }
+            if(use_formula && !passes(formula)) continue;
+            reader_gone = !push(entry);
+          }
+          reader_gone = reader_gone || !push(-1);
+        } while(loop && !reader_gone);
+        chain.SetNotify(nullptr);
+      }
+      catch(...) {
+        std::lock_guard<std::mutex> lock(fMutex);
+        fError = std::current_exception();
+        fCond.notify_all();
+      }
+    }
+
+    std::mutex fMutex;
+    std::condition_variable fCond;
+    std::deque<long> fQueue;
+    const size_t fDepth;
+    bool fStop;
+    std::exception_ptr fError;
+    std::thread fThread; // last, starts once everything else is set up
+};
+
 hpsgen::FluxReader::~FluxReader() {
+  fPrefetch.reset();
+  if(fPreselection) fFluxTree->SetNotify(nullptr);
+  fPreselection.reset();
   delete fFluxTree;
 }
 
@@ -178,73 +382,192 @@ void hpsgen::FluxReader::set_branch(void* obj, const char* bname) {
   fFluxTree->SetBranchAddress(bname, obj);
 }
 
-void hpsgen::FluxReader::get_next_entry() {
-  if(fCache.empty()) {
-    if(fUseCache) {
-      fCache.resize(fFluxTree->GetEntries());
-      fSelectedEntries.reserve(fFluxTree->GetEntries());
-    }
-    else fCache.resize(1);
+void hpsgen::FluxReader::setup_reading() {
+  fReadingSetUp = true;
+  const long long cache_size = (long long)fTreeCacheMB * 1024ll * 1024ll;
+  if(cache_size > 0) {
+    fFluxTree->SetCacheSize(cache_size);
+    fFluxTree->AddBranchToCache("*", true);
   }
+  const std::string selection = preselection();
+  if(selection.empty()) return;
+
+  if(fPrefetchDepth > 0) {
+    std::vector<std::string> files;
+    for(int i = 0; i < fFluxTree->GetNtrees(); ++i) files.push_back(fFluxTree->GetListOfFiles()->At(i)->GetTitle());
+    ROOT::EnableThreadSafety();
+    // with the cache, only the first pass needs to be preselected
+    fPrefetch.reset(new prefetcher(files, fEntriesPerFluxFile, fFluxTree->GetName(), selection, !fUseCache, fPrefetchDepth, cache_size));
+    return;
+  }
+  fFluxTree->LoadTree(0);
+  fPreselection.reset(new TTreeFormula("preselection", selection.c_str(), fFluxTree));
+  if(fPreselection->GetNdim() == 0) {
+    std::cout << "hpsgen::FluxReader : cannot use flux preselection '"<<selection<<"', reading every entry"<<std::endl;
+    fPreselection.reset();
+    return;
+  }
+  fFluxTree->SetNotify(fPreselection.get());
+}
+
+bool hpsgen::FluxReader::preselected(long entry) {
+  if(!fPreselection) return true;
+  if(fFluxTree->LoadTree(entry) < 0) {
+    throw cet::exception("LogicError") << "cannot read flux entry "<<entry<<std::endl;
+  }
+  return passes(*fPreselection);
+}
+
+void hpsgen::FluxReader::get_next_entry() {
   if(fUseCache && fFullChainsSeen > 0) {
-    fCurrSelectedEntry++;
-    if(fCurrSelectedEntry >= fSelectedEntries.end()) {
-      fCurrSelectedEntry = fSelectedEntries.begin();
+    // replay the kaons selected during the first pass, without reading the flux files
+    if(++fCurrKaon >= fKaons.size()) {
+      fCurrKaon = 0;
       fFullChainsSeen++;
     }
-    fCurrEntry = *fCurrSelectedEntry;
+    fCurrEntry = fKaons.entry[fCurrKaon];
     return;
   }
-  fCurrEntry++;
-  if(fCurrEntry >= fFluxTree->GetEntries()) {
-    fCurrEntry = 0;
-    fFullChainsSeen++;
-    if(fUseCache) {
-      fCurrSelectedEntry = fSelectedEntries.begin();
-      fCurrSelectedEntry--; // this will be ++ed again on next entry
-      return get_next_entry();
+  if(!fReadingSetUp) setup_reading();
+  while(true) {
+    // entries failing the preselection are only read in part, or by the prefetch thread
+    if(fPrefetch) {
+      const long entry = fPrefetch->next();
+      fCurrEntry = (entry < 0 ? fFluxTree->GetEntries() : entry);
     }
+    else fCurrEntry++;
+    if(fCurrEntry >= fFluxTree->GetEntries()) {
+      fCurrEntry = 0;
+      fFullChainsSeen++;
+      if(fUseCache) {
+        if(fKaons.size() == 0) {
+          throw cet::exception("Configuration") << "No kaons selected from the flux files."<<std::endl;
+        }
+        fKaons.shrink_to_fit();
+        std::cout << "hpsgen::FluxReader::get_next_entry : selected "<<fKaons.size()<<" kaons from "<<fFluxTree->GetEntries()<<" flux entries"<<std::endl;
+        fCurrKaon = 0;
+        fCurrEntry = fKaons.entry[fCurrKaon];
+        fPrefetch.reset();
+        return;
+      }
+      if(fPrefetch) continue;
+    }
+    if(!fPrefetch && !preselected(fCurrEntry)) continue;
+    fFluxTree->GetEntry(fCurrEntry);
+    if(get_kaon_from_flux(fCurrent.kmom, fCurrent.kpos, fCurrent.kpdg, fCurrent.pi_type, fCurrent.weight)) break;
   }
-  fFluxTree->GetEntry(fCurrEntry);
-  auto& cache = fUseCache ? fCache.at(fCurrEntry) : fCache.front();
-  if(!get_kaon_from_flux(cache.kmom, cache.kpos, cache.kpdg, cache.pi_type, cache.weight)){
-    return get_next_entry();
-  }
-  if(fUseCache) fSelectedEntries.push_back(fCurrEntry);
+  if(fUseCache) fKaons.push_back(fCurrEntry, fCurrent);
 }
 
 void hpsgen::FluxReader::get_current_entry() {
   if(fUseCache && fFullChainsSeen > 0) fFluxTree->GetEntry(fCurrEntry);
 }
 
-void hpsgen::FluxReader::count_pot(const char* bname, const char* tname) {
-  const size_t n_trees = fFluxTree->GetNtrees();
+void hpsgen::FluxReader::count_pot(const std::vector<flux_file>& files, const char* bname, const char* tname) {
+  const size_t n_trees = files.size();
+  const std::string tree_name = fFluxTree->GetName();
+  std::vector<pot_count> counts(n_trees);
+  std::vector<std::string> keys(n_trees);
+
+  // files already counted by an earlier job, if unchanged since
+  std::map<std::string, pot_count> index;
+  if(!fPOTIndexFile.empty()) index = read_pot_index(fPOTIndexFile);
+  std::vector<size_t> to_count;
+  for(size_t i = 0; i < n_trees; ++i) {
+    if(files[i].size >= 0) {
+      keys[i] = files[i].key + '\t' + std::to_string(files[i].size) + '\t' + std::to_string(files[i].mtime)
+        + '\t' + tree_name + '\t' + bname + '\t' + tname;
+      auto const it = index.find(keys[i]);
+      if(it != index.end()) {
+        counts[i] = it->second;
+        continue;
+      }
+    }
+    to_count.push_back(i);
+  }
+
+  // the others are opened in parallel, each thread with its own TFile
+  if(!to_count.empty()) {
+    ROOT::EnableThreadSafety();
+    std::atomic<size_t> next(0);
+    std::vector<std::exception_ptr> errors(to_count.size());
+    auto count = [&]() {
+      for(size_t k = next++; k < to_count.size(); k = next++) {
+        try {
+          counts[to_count[k]] = count_file_pot(files[to_count[k]].name, tree_name.c_str(), bname, tname);
+        }
+        catch(...) {
+          errors[k] = std::current_exception();
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for(size_t t = 1; t < std::min<size_t>(fPOTThreads, to_count.size()); ++t) threads.emplace_back(count);
+    count();
+    for(auto& t : threads) t.join();
+    for(auto const& e : errors) {
+      if(e) std::rethrow_exception(e);
+    }
+
+    if(!fPOTIndexFile.empty()) {
+      // re-read, in case another job updated the index in the meantime
+      index = read_pot_index(fPOTIndexFile);
+      for(size_t i : to_count) {
+        if(!keys[i].empty()) index[keys[i]] = counts[i];
+      }
+      write_pot_index(fPOTIndexFile, index);
+    }
+  }
+
+  // with the number of entries given, the chain does not need to open the files
   fTotalPOTinFluxFiles = 0.;
   fPOTperFluxFile.resize(n_trees);
   fEntriesPerFluxFile.resize(n_trees);
   for(size_t i = 0; i < n_trees; ++i) {
-    TFile *f = TFile::Open(fFluxTree->GetListOfFiles()->At(i)->GetTitle());
-    TTree *t = (TTree*)f->Get(tname);
-    if(!t) {
-      throw cet::exception("Configuration") << "cannot read pot counting tree in flux files";
-    }
-    t->Draw("1",bname,"goff");
-    const double pot = std::accumulate(t->GetW(),t->GetW()+t->GetSelectedRows(), 0.);
-    fPOTperFluxFile[i] = pot;
-    fTotalPOTinFluxFiles += pot;
-    fEntriesPerFluxFile[i] = (i < n_trees-1 ? fFluxTree->GetTreeOffset()[i+1]-fFluxTree->GetTreeOffset()[i] : fFluxTree->GetEntries()-fFluxTree->GetTreeOffset()[i] );
-    delete f;
-    //std::cerr <<i<< " pot: "<<pot << std::endl;
+    fFluxTree->Add(files[i].name.c_str(), counts[i].entries);
+    fPOTperFluxFile[i] = counts[i].pot;
+    fTotalPOTinFluxFiles += counts[i].pot;
+    fEntriesPerFluxFile[i] = counts[i].entries;
+    //std::cerr <<i<< " pot: "<<counts[i].pot << std::endl;
   }
-  std::cout << "hpsgen::FluxReader::count_pot : read "<<n_trees<<" files, with total pot = "<<fTotalPOTinFluxFiles<<std::endl;
+  std::cout << "hpsgen::FluxReader::count_pot : read "<<n_trees<<" files ("<<n_trees-to_count.size()<<" from the pot index), with total pot = "<<fTotalPOTinFluxFiles<<std::endl;
 }
 
 double hpsgen::FluxReader::get_kaon(TLorentzVector& kmom, TLorentzVector& kpos, int& kpdg, int& pi_type) {
   get_next_entry();
-  auto const& centry = fUseCache ? fCache.at(fCurrEntry) : fCache.front();
-  kmom = centry.kmom;
-  kpos = centry.kpos;
-  kpdg = centry.kpdg;
-  pi_type = centry.pi_type;
-  return centry.weight;
+  if(fUseCache && fFullChainsSeen > 0) return fKaons.get(fCurrKaon, kmom, kpos, kpdg, pi_type);
+  kmom = fCurrent.kmom;
+  kpos = fCurrent.kpos;
+  kpdg = fCurrent.kpdg;
+  pi_type = fCurrent.pi_type;
+  return fCurrent.weight;
+}
+
+void hpsgen::FluxReader::kaon_store::shrink_to_fit() {
+  entry.shrink_to_fit();
+  px.shrink_to_fit(); py.shrink_to_fit(); pz.shrink_to_fit(); mass.shrink_to_fit();
+  x.shrink_to_fit(); y.shrink_to_fit(); z.shrink_to_fit(); t.shrink_to_fit();
+  pdg.shrink_to_fit();
+  pi_type.shrink_to_fit();
+  weight.shrink_to_fit();
+}
+
+void hpsgen::FluxReader::kaon_store::push_back(long ientry, const kaon& k) {
+  if(k.kpdg < INT16_MIN || k.kpdg > INT16_MAX || k.pi_type < INT8_MIN || k.pi_type > INT8_MAX) {
+    throw cet::exception("LogicError")<<"Cannot store kaon with pdg "<<k.kpdg<<" and pion type "<<k.pi_type<<std::endl;
+  }
+  entry.push_back(ientry);
+  px.push_back(k.kmom.Px()); py.push_back(k.kmom.Py()); pz.push_back(k.kmom.Pz()); mass.push_back(k.kmom.M());
+  x.push_back(k.kpos.X()); y.push_back(k.kpos.Y()); z.push_back(k.kpos.Z()); t.push_back(k.kpos.T());
+  pdg.push_back(k.kpdg);
+  pi_type.push_back(k.pi_type);
+  weight.push_back(k.weight);
+}
+
+double hpsgen::FluxReader::kaon_store::get(size_t i, TLorentzVector& kmom, TLorentzVector& kpos, int& kpdg, int& kpi_type) const {
+  kmom.SetXYZM(px[i], py[i], pz[i], mass[i]);
+  kpos.SetXYZT(x[i], y[i], z[i], t[i]);
+  kpdg = pdg[i];
+  kpi_type = pi_type[i];
+  return weight[i];
 }
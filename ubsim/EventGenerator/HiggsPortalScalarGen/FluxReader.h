@@ -3,9 +3,13 @@
 
 #include "fhiclcpp/ParameterSet.h"
 #include "TLorentzVector.h"
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 
 class TChain;
+class TTreeFormula;
 
 namespace simb {
   class MCFlux;
@@ -33,9 +37,23 @@ namespace hpsgen {
       void set_branch(void* obj, const char* bname);
       void get_current_entry();
       virtual bool get_kaon_from_flux(TLorentzVector& kmom, TLorentzVector& kpos, int& kpdg, int& pi_type, double& weight) = 0;
+      // necessary condition for get_kaon_from_flux to accept an entry, as a
+      // TTree::Draw selection. Only the branches it uses are read for entries
+      // failing it. Empty to read every entry in full.
+      virtual const char* preselection() const { return ""; }
     private:
+      class prefetcher;
+      // a flux file, and what identifies it in the POT index
+      struct flux_file {
+        std::string name; // as opened by ROOT
+        std::string key;  // path used in the index
+        long long size;   // < 0 if unknown, then not indexed
+        long long mtime;
+      };
       void get_next_entry();
-      void count_pot(const char* bname, const char* tname);
+      void setup_reading();
+      bool preselected(long entry);
+      void count_pot(const std::vector<flux_file>& files, const char* bname, const char* tname);
       const std::string fFluxLocation;
       const std::string fFluxAccessSchema;
       bool fUseCache;
@@ -46,17 +64,40 @@ namespace hpsgen {
       std::vector<unsigned long> fEntriesPerFluxFile;
       unsigned int fFullChainsSeen;
       unsigned int fMaxFluxFileMB; // for IFDH copies
+      const std::string fPOTIndexFile; // POT and entries per flux file from earlier jobs
+      const unsigned int fPOTThreads;  // flux files opened in parallel to count POT
+      const unsigned int fPrefetchDepth; // preselected entries queued ahead by the prefetch thread
+      const unsigned int fTreeCacheMB;
+      bool fReadingSetUp;
+      std::unique_ptr<TTreeFormula> fPreselection; // without prefetch thread
+      std::unique_ptr<prefetcher> fPrefetch;
+
+      // kaon accepted by get_kaon_from_flux from the current flux entry,
+      // at full precision
+      struct kaon {
+        TLorentzVector kmom, kpos;
+        int kpdg = 0, pi_type = 0;
+        double weight = 0.;
+      };
+      kaon fCurrent;
+
+      // with use_flux_cache, the kaons accepted during the first pass over the
+      // flux files, one array per quantity, replayed on later passes
+      struct kaon_store {
+        std::vector<long> entry; // chain entry
+        std::vector<float> px, py, pz, mass;
+        std::vector<float> x, y, z, t;
+        std::vector<int16_t> pdg;
+        std::vector<int8_t> pi_type;
+        std::vector<double> weight;
 
-      struct cache {
-        TLorentzVector kmom;
-        TLorentzVector kpos;
-        int kpdg;
-        int pi_type;
-        double weight;
+        size_t size() const { return entry.size(); }
+        void shrink_to_fit();
+        void push_back(long ientry, const kaon& k);
+        double get(size_t i, TLorentzVector& kmom, TLorentzVector& kpos, int& kpdg, int& kpi_type) const;
       };
-      std::vector<cache> fCache;
-      std::vector<long> fSelectedEntries;
-      std::vector<long>::iterator fCurrSelectedEntry;
+      kaon_store fKaons;
+      size_t fCurrKaon;
   };
 }
 
@@ -30,6 +30,11 @@ hpsgen::FluxReaderBNB::FluxReaderBNB(fhicl::ParameterSet const& p, CLHEP::HepRan
 hpsgen::FluxReaderBNB::~FluxReaderBNB() {
 }
 
+// kaon decays, as selected by get_kaon_from_flux
+const char* hpsgen::FluxReaderBNB::preselection() const {
+  return "npart > 1 && id[1] >= 10 && id[1] <= 12";
+}
+
 bool hpsgen::FluxReaderBNB::get_kaon_from_flux(TLorentzVector& kmom, TLorentzVector& kpos, int& kpdg, int& pi_type, double& weight) {
   if(!(fBranch.npart > 1 && fBranch.id[1]>=10 && fBranch.id[1] <= 12)) return false; // only select kaon decays
   // id 10 == K0L; id 11 = K+, id 12 = K-
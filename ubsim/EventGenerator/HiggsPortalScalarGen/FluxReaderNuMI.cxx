@@ -26,6 +26,11 @@ hpsgen::FluxReaderNuMI::~FluxReaderNuMI() {
   if(dk2nu) delete dk2nu;
 }
 
+// kaon decays, as selected by get_kaon_from_flux
+const char* hpsgen::FluxReaderNuMI::preselection() const {
+  return "decay.ndecay > 0 && decay.ndecay <= 10";
+}
+
 bool hpsgen::FluxReaderNuMI::get_kaon_from_flux(TLorentzVector& kmom, TLorentzVector& kpos, int& kpdg, int& pi_type, double& weight) {
   if(dk2nu->decay.ndecay <= 0 || dk2nu->decay.ndecay > 10) return false; // only select kaon decays
   //std::cerr << "DEBUG "<<__FILE__<<" "<<__LINE__<<" " <<dk2nu->decay.ndecay<<" "<<dk2nu->decay.ptype<<std::endl;
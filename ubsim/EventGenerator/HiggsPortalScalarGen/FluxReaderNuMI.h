@@ -22,6 +22,7 @@ namespace hpsgen {
       void get_MCFlux(simb::MCFlux& flux);
     private:
       bool get_kaon_from_flux(TLorentzVector& kmom, TLorentzVector& kpos, int& kpdg, int& pi_type, double& weight);
+      const char* preselection() const;
       double K2nu_branching_ratio(const int ndecay);
       bsim::Dk2Nu *dk2nu;
       const TVector3 beampos;
@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////
+// Class:       CompactEventWeight
+// Plugin Type: producer
+// File:        CompactEventWeight_module.cc
+//
+// Stores the std::vector<evwgh::MCEventWeight> of an EventWeight module
+// as one evwgh::CompactEventWeights per event plus one
+// evwgh::CompactWeightTable per run (see CompactEventWeight.h). The
+// table lists every weight function seen in the run; each event records
+// how many universes each function returned for each of its MCTruths.
+////////////////////////////////////////////////////////////////////////
+
+#include "art/Framework/Core/EDProducer.h"
+#include "art/Framework/Core/ModuleMacros.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+#include "art/Framework/Principal/Run.h"
+#include "canvas/Utilities/InputTag.h"
+#include "cetlib_except/exception.h"
+#include "fhiclcpp/ParameterSet.h"
+
+#include "larsim/EventWeight/Base/MCEventWeight.h"
+
+#include "ubsim/EventWeight/Products/CompactEventWeight.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class CompactEventWeight : public art::EDProducer {
+public:
+  explicit CompactEventWeight(fhicl::ParameterSet const& p);
+
+  void produce(art::Event& e) override;
+  void beginRun(art::Run& r) override;
+  void endRun(art::Run& r) override;
+
+private:
+
+  art::InputTag fEventWeightLabel;
+  int fEncoding;
+  double fLogStep;
+
+  std::unique_ptr<evwgh::CompactWeightTable> fTable;
+};
+
+
+CompactEventWeight::CompactEventWeight(fhicl::ParameterSet const& p)
+  : EDProducer{p},
+  fEventWeightLabel{p.get<art::InputTag>("EventWeightLabel")},
+  fLogStep{p.get<double>("LogStep", 5.e-4)}
+{
+  std::string encoding = p.get<std::string>("Encoding", "float");
+  if (encoding == "float") fEncoding = evwgh::kFloatWeights;
+  else if (encoding == "log16") fEncoding = evwgh::kLog16Weights;
+  else throw cet::exception("CompactEventWeight")
+    << "Unknown Encoding \"" << encoding << "\", use \"float\" or \"log16\"\n";
+
+  if (fEncoding == evwgh::kLog16Weights && !(fLogStep > 0.)) {
+    throw cet::exception("CompactEventWeight")
+      << "LogStep must be positive, got " << fLogStep << '\n';
+  }
+
+  consumes< std::vector<evwgh::MCEventWeight> >(fEventWeightLabel);
+  produces< evwgh::CompactEventWeights >();
+  produces< evwgh::CompactWeightTable, art::InRun >();
+}
+
+
+void CompactEventWeight::beginRun(art::Run&)
+{
+  fTable = std::make_unique<evwgh::CompactWeightTable>();
+  fTable->fEncoding = fEncoding;
+  fTable->fLogStep = fEncoding == evwgh::kLog16Weights ? fLogStep : 0.;
+}
+
+
+void CompactEventWeight::endRun(art::Run& r)
+{
+  // Only the events seen by this job went into the table
+  r.put(std::move(fTable), art::runFragment());
+}
+
+
+void CompactEventWeight::produce(art::Event& e)
+{
+  auto const& mcweights = e.getProduct< std::vector<evwgh::MCEventWeight> >(fEventWeightLabel);
+
+  // Weight functions that were absent (or empty) so far get a new entry at
+  // the end of the table; earlier events keep their numbering
+  size_t nweights = 0;
+  for (auto const& mcwgh : mcweights) {
+    for (auto const& func : mcwgh.fWeight) {
+      fTable->Add(func.first);
+      nweights += func.second.size();
+    }
+  }
+
+  auto out = std::make_unique<evwgh::CompactEventWeights>();
+  out->fNTruths = mcweights.size();
+  out->fNFunctions = fTable->fNames.size();
+
+  size_t const nfunc = out->fNFunctions;
+  bool const quantize = fEncoding == evwgh::kLog16Weights;
+
+  out->fSizes.assign(mcweights.size() * nfunc, 0);
+  if (quantize) out->fLog16.reserve(nweights);
+  else out->fFloat.reserve(nweights);
+
+  for (size_t itruth = 0; itruth < mcweights.size(); ++itruth) {
+    auto const& funcs = mcweights[itruth].fWeight;
+    for (size_t ifunc = 0; ifunc < nfunc; ++ifunc) {
+      auto it = funcs.find(fTable->fNames[ifunc]);
+      if (it == funcs.end()) continue;
+
+      out->fSizes[itruth * nfunc + ifunc] = it->second.size();
+      for (double w : it->second) {
+        if (quantize) out->fLog16.push_back(evwgh::EncodeLog16(w, fLogStep));
+        else out->fFloat.push_back(w);
+      }
+    }
+  }
+
+  e.put(std::move(out));
+}
+
+DEFINE_ART_MODULE(CompactEventWeight)
@@ -0,0 +1,274 @@
+////////////////////////////////////////////////////////////////////////
+// Class:       EventWeightBenchmark
+// Plugin Type: analyzer
+// File:        EventWeightBenchmark_module.cc
+//
+// Runs the weight calculators of an EventWeight producer configuration
+// one by one on the events of the input file and reports, per
+// calculator, the configuration time, the time per event and per
+// universe, and the growth of the peak resident memory. When the input
+// already holds the weights of an EventWeight producer (ReferenceLabel),
+// the new weights are compared to them; with FailOnMismatch, the job
+// fails at the end if any weight differs or none could be compared.
+//
+// Some calculators share per-event work (e.g. the GENIE event records of
+// the UBGenie calculators), which would be charged to whichever of them
+// runs first. With WarmUp, every calculator is evaluated once per event
+// before the timed evaluations, and the time of that pass, which includes
+// reading the truth and filling the shared caches, is reported on its own.
+//
+// The calculators are created and seeded as in the EventWeight producer
+// (seed from "random_seed" when given), so reference weights made with
+// the same configuration and seeds are reproduced exactly.
+////////////////////////////////////////////////////////////////////////
+
+#include "art/Framework/Core/EDAnalyzer.h"
+#include "art/Framework/Core/ModuleMacros.h"
+#include "art/Framework/Principal/Event.h"
+#include "art/Framework/Principal/Handle.h"
+#include "canvas/Utilities/InputTag.h"
+#include "cetlib_except/exception.h"
+#include "fhiclcpp/ParameterSet.h"
+#include "messagefacility/MessageLogger/MessageLogger.h"
+
+#include "CLHEP/Random/JamesRandom.h"
+
+#include "larsim/EventWeight/Base/MCEventWeight.h"
+#include "larsim/EventWeight/Base/WeightCalc.h"
+#include "larsim/EventWeight/Base/WeightCalcFactory.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+  // Peak resident set size of the job so far [MB]
+  double PeakRSS()
+  {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.;
+  }
+
+  double Seconds(std::chrono::steady_clock::time_point t0)
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  }
+
+}
+
+class EventWeightBenchmark : public art::EDAnalyzer {
+public:
+  explicit EventWeightBenchmark(fhicl::ParameterSet const& p);
+
+  void analyze(art::Event const& e) override;
+  void endJob() override;
+
+private:
+
+  struct CalcStats {
+    std::string name;
+    std::string type;
+    std::unique_ptr<CLHEP::HepRandomEngine> engine;
+    std::unique_ptr<evwgh::WeightCalc> calc;
+    double time_configure = 0;  // [s]
+    double time_events = 0;     // [s], all repetitions
+    double universes = 0;       // weights computed, all repetitions
+    double peak_rss_growth = 0; // [MB]
+    size_t compared = 0;        // weights compared to the reference
+    size_t mismatched = 0;      // ... of which outside the tolerance
+    double max_deviation = 0;
+  };
+
+  void Compare(CalcStats& stats,
+               std::vector<std::vector<double>> const& weights,
+               std::vector<evwgh::MCEventWeight> const& reference) const;
+
+  art::InputTag fReferenceLabel;
+  double fTolerance;
+  unsigned fRepeat;
+  bool fWarmUp;
+  bool fFailOnMismatch;
+  size_t fNEvents = 0;
+  double fTimeWarmUp = 0; // [s], first evaluation of all calculators
+
+  std::vector<CalcStats> fCalcs;
+};
+
+
+EventWeightBenchmark::EventWeightBenchmark(fhicl::ParameterSet const& p)
+  : EDAnalyzer{p},
+  fReferenceLabel{p.get<std::string>("ReferenceLabel", "")},
+  fTolerance{p.get<double>("Tolerance", 1.e-6)},
+  fRepeat{std::max(p.get<unsigned>("Repeat", 1), 1u)},
+  fWarmUp{p.get<bool>("WarmUp", true)},
+  fFailOnMismatch{p.get<bool>("FailOnMismatch", false)}
+{
+  // Same calculator setup as the EventWeight producer
+  fhicl::ParameterSet const weights = p.get<fhicl::ParameterSet>("Weights");
+  long const default_seed = p.get<long>("DefaultSeed", 12345);
+
+  for (auto const& name : weights.get<std::vector<std::string>>("weight_functions")) {
+    fhicl::ParameterSet const ps_func = weights.get<fhicl::ParameterSet>(name);
+
+    CalcStats stats;
+    stats.name = name;
+    stats.type = ps_func.get<std::string>("type");
+    stats.engine = std::make_unique<CLHEP::HepJamesRandom>(ps_func.get<long>("random_seed", default_seed));
+
+    double const rss0 = PeakRSS();
+    auto const t0 = std::chrono::steady_clock::now();
+    stats.calc.reset(evwgh::WeightCalcFactory::Create(stats.type + "WeightCalc"));
+    if (!stats.calc) {
+      throw cet::exception("EventWeightBenchmark")
+        << "Unknown weight calculator type " << stats.type << " for " << name << '\n';
+    }
+    stats.calc->SetName(name);
+    stats.calc->Configure(weights, *stats.engine);
+    stats.time_configure = Seconds(t0);
+    stats.peak_rss_growth = PeakRSS() - rss0;
+
+    fCalcs.push_back(std::move(stats));
+  }
+
+  if (!fReferenceLabel.empty()) consumes< std::vector<evwgh::MCEventWeight> >(fReferenceLabel);
+  else if (fFailOnMismatch) {
+    throw cet::exception("EventWeightBenchmark")
+      << "FailOnMismatch needs a ReferenceLabel to compare to\n";
+  }
+}
+
+
+void EventWeightBenchmark::analyze(art::Event const& e)
+{
+  ++fNEvents;
+
+  std::vector<evwgh::MCEventWeight> const* reference = nullptr;
+  if (!fReferenceLabel.empty()) {
+    auto handle = e.getHandle< std::vector<evwgh::MCEventWeight> >(fReferenceLabel);
+    if (handle) reference = handle.product();
+  }
+
+  // WeightCalc::GetWeight takes a non-const event
+  art::Event& event = const_cast<art::Event&>(e);
+
+  if (fWarmUp) {
+    auto const t0 = std::chrono::steady_clock::now();
+    for (auto& stats : fCalcs) {
+      double const rss0 = PeakRSS();
+      stats.calc->GetWeight(event);
+      stats.peak_rss_growth += PeakRSS() - rss0;
+    }
+    fTimeWarmUp += Seconds(t0);
+  }
+
+  for (auto& stats : fCalcs) {
+    double const rss0 = PeakRSS();
+    std::vector<std::vector<double>> weights;
+
+    auto const t0 = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < fRepeat; ++i) {
+      weights = stats.calc->GetWeight(event);
+      for (auto const& w : weights) stats.universes += w.size();
+    }
+    stats.time_events += Seconds(t0);
+    stats.peak_rss_growth += PeakRSS() - rss0;
+
+    if (reference) Compare(stats, weights, *reference);
+  }
+}
+
+
+void EventWeightBenchmark::Compare(CalcStats& stats,
+                                   std::vector<std::vector<double>> const& weights,
+                                   std::vector<evwgh::MCEventWeight> const& reference) const
+{
+  for (size_t itruth = 0; itruth < weights.size(); ++itruth) {
+    std::vector<double> const* ref = nullptr;
+    if (itruth < reference.size()) {
+      auto it = reference[itruth].fWeight.find(stats.name);
+      if (it != reference[itruth].fWeight.end()) ref = &it->second;
+    }
+    if (!ref) {
+      // weights the reference does not have
+      stats.compared += weights[itruth].size();
+      stats.mismatched += weights[itruth].size();
+      continue;
+    }
+
+    size_t const n = std::max(ref->size(), weights[itruth].size());
+    for (size_t j = 0; j < n; ++j) {
+      ++stats.compared;
+      if (j >= ref->size() || j >= weights[itruth].size()) {
+        ++stats.mismatched;
+        continue;
+      }
+      double const a = weights[itruth][j];
+      double const b = (*ref)[j];
+      double const dev = std::abs(a - b) / std::max(1., std::abs(b));
+      if (!(dev <= fTolerance)) ++stats.mismatched;
+      if (std::isfinite(dev)) stats.max_deviation = std::max(stats.max_deviation, dev);
+    }
+  }
+}
+
+
+void EventWeightBenchmark::endJob()
+{
+  mf::LogInfo log("EventWeightBenchmark");
+  log << "Weight calculators on " << fNEvents << " events"
+      << " (x" << fRepeat << "), peak RSS " << PeakRSS() << " MB:";
+  if (fWarmUp) {
+    log << "\n\twarm-up pass over all calculators (truth reading, shared caches, not in the times below): "
+        << 1e3 * fTimeWarmUp / std::max<double>(fNEvents, 1) << " [ms]/event";
+  }
+  log << "\n\t" << std::left << std::setw(28) << "name"
+      << std::setw(26) << "type"
+      << std::right << std::setw(12) << "config [s]"
+      << std::setw(14) << "[ms]/event"
+      << std::setw(16) << "[us]/universe"
+      << std::setw(14) << "univ/event"
+      << std::setw(12) << "RSS+ [MB]";
+  if (!fReferenceLabel.empty()) log << std::setw(22) << "mismatched/compared" << std::setw(12) << "max dev.";
+
+  double const nevents = std::max<double>(fNEvents * fRepeat, 1);
+  for (auto const& stats : fCalcs) {
+    log << "\n\t" << std::left << std::setw(28) << stats.name
+        << std::setw(26) << stats.type
+        << std::right << std::setw(12) << stats.time_configure
+        << std::setw(14) << 1e3 * stats.time_events / nevents
+        << std::setw(16) << (stats.universes > 0 ? 1e6 * stats.time_events / stats.universes : 0.)
+        << std::setw(14) << stats.universes / nevents
+        << std::setw(12) << stats.peak_rss_growth;
+    if (!fReferenceLabel.empty()) {
+      log << std::setw(22) << (std::to_string(stats.mismatched) + "/" + std::to_string(stats.compared))
+          << std::setw(12) << stats.max_deviation;
+    }
+  }
+
+  size_t mismatched = 0, compared = 0;
+  for (auto const& stats : fCalcs) {
+    mismatched += stats.mismatched;
+    compared += stats.compared;
+    if (stats.mismatched > 0) {
+      mf::LogWarning("EventWeightBenchmark")
+        << stats.name << ": " << stats.mismatched << " of " << stats.compared
+        << " weights differ from " << fReferenceLabel.encode() << " by more than " << fTolerance;
+    }
+  }
+
+  if (fFailOnMismatch && (mismatched > 0 || compared == 0)) {
+    throw cet::exception("EventWeightBenchmark")
+      << mismatched << " of " << compared << " weights differ from "
+      << fReferenceLabel.encode() << " by more than " << fTolerance << '\n';
+  }
+}
+
+DEFINE_ART_MODULE(EventWeightBenchmark)
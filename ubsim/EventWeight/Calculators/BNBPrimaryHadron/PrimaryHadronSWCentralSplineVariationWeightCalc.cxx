@@ -30,6 +30,7 @@
 #include "nusimdata/SimulationBase/MCTruth.h"
 #include "nusimdata/SimulationBase/GTruth.h"
 
+#include <algorithm>
 #include <vector>
 #include "TH1.h"
 #include "TArrayD.h"
@@ -46,6 +47,93 @@
 
 using namespace std;
 
+namespace {
+
+  //
+  // Natural cubic spline ("b2e2" with zero second derivatives at both ends)
+  // written as a linear combination of its knot values. For a fixed set of
+  // knots the spline through y is S(x) = sum_j w_j(x) y_j, so the weights
+  // w_j(x) can be evaluated once per event and shared by every universe.
+  // Segment lookup and extrapolation follow TSpline3::Eval.
+  //
+  class NaturalSplineBasis {
+  public:
+    NaturalSplineBasis() = default;
+
+    explicit NaturalSplineBasis(std::vector<double> const& knots)
+      : fKnots(knots)
+    {
+      size_t const n = fKnots.size();
+      if(n < 2){
+	throw art::Exception(art::errors::Configuration)
+	  << "A spline needs at least two knots";
+      }
+
+      fCoeff.assign(4*n*(n - 1), 0.);
+      std::vector<double> y(n), m(n), diag(n), rhs(n);
+      for(size_t j = 0; j < n; j++){
+	std::fill(y.begin(), y.end(), 0.);
+	y[j] = 1.;
+
+	// Solve the tridiagonal system for the second derivatives
+	std::fill(m.begin(), m.end(), 0.);
+	for(size_t k = 1; k + 1 < n; k++){
+	  double const h0 = fKnots[k] - fKnots[k - 1];
+	  double const h1 = fKnots[k + 1] - fKnots[k];
+	  diag[k] = 2.*(h0 + h1);
+	  rhs[k] = 6.*((y[k + 1] - y[k])/h1 - (y[k] - y[k - 1])/h0);
+	  if(k > 1){
+	    double const f = h0/diag[k - 1];
+	    diag[k] -= f*h0;
+	    rhs[k] -= f*rhs[k - 1];
+	  }
+	}
+	for(size_t k = n - 2; k >= 1; k--){
+	  m[k] = (rhs[k] - (k + 2 < n ? (fKnots[k + 1] - fKnots[k])*m[k + 1] : 0.))/diag[k];
+	}
+
+	for(size_t k = 0; k + 1 < n; k++){
+	  double const h = fKnots[k + 1] - fKnots[k];
+	  double* c = &fCoeff[4*(k*n + j)];
+	  c[0] = y[k];
+	  c[1] = (y[k + 1] - y[k])/h - h*(2.*m[k] + m[k + 1])/6.;
+	  c[2] = 0.5*m[k];
+	  c[3] = (m[k + 1] - m[k])/(6.*h);
+	}
+      }
+    }
+
+    size_t size() const { return fKnots.size(); }
+
+    // Fills w[0..size()) with the weight of each knot value at x
+    void Weights(double x, double* w) const
+    {
+      size_t const n = fKnots.size();
+      size_t k = 0;
+      for(size_t j = 1; j + 1 < n; j++) k += (x > fKnots[j]);
+
+      double const dx = x - fKnots[k];
+      double const* c = &fCoeff[4*k*n];
+      for(size_t j = 0; j < n; j++, c += 4){
+	w[j] = c[0] + dx*(c[1] + dx*(c[2] + dx*c[3]));
+      }
+    }
+
+  private:
+    std::vector<double> fKnots;
+    std::vector<double> fCoeff; // [segment][knot][a, b, c, d]
+  };
+
+  // TSpline3 built from a TH1 places its knots at the bin centers
+  std::vector<double> BinCenters(std::vector<double> const& edges)
+  {
+    std::vector<double> centers(edges.size() - 1);
+    for(size_t i = 0; i < centers.size(); i++) centers[i] = edges[i] + 0.5*(edges[i + 1] - edges[i]);
+    return centers;
+  }
+
+} // anonymous namespace
+
 namespace evwgh {
   class PrimaryHadronSWCentralSplineVariationWeightCalc : public WeightCalc
   {
@@ -53,14 +141,17 @@ namespace evwgh {
     PrimaryHadronSWCentralSplineVariationWeightCalc() = default;
     void Configure(fhicl::ParameterSet const& p,
                    CLHEP::HepRandomEngine& engine);
-    std::pair< bool, double > MiniBooNEWeightCalc(simb::MCFlux flux, std::vector<double> rand);
-    std::pair< bool, double > MicroBooNEWeightCalc(simb::MCFlux flux,std::vector<double> rand);
+    std::pair< bool, double > MiniBooNEWeightCalc(simb::MCFlux const& flux, std::vector<double> const& rand);
+    std::pair< bool, double > MicroBooNEWeightCalc(simb::MCFlux const& flux, std::vector<double> const& rand);
     virtual std::vector<std::vector<double> > GetWeight(art::Event & e);
     std::vector< std::vector< double > > MiniBooNERandomNumbers(std::string);
     
   private:
     // unused CLHEP::RandGaussQ *fGaussRandom{nullptr};
     std::vector<double> ConvertToVector(TArrayD const* array);
+    void PrecomputeUniverses();
+    double CentralValue(simb::MCFlux const& flux, double& momentum, double& theta) const;
+    double FinalWeight(double RW, double CV) const;
     std::string fGenieModuleLabel{};
     std::vector<std::string> fParameter_list{};
     float fParameter_sigma{};
@@ -87,6 +178,24 @@ namespace evwgh {
     std::vector<double> SWParam{};
 
     bool fIsDecomposed{false};
+    bool fUseMicroBooNE{true};
+
+    //
+    // Everything that does not depend on the event is built once in
+    // Configure: the smeared HARP cross sections of each universe, stored
+    // flat as [universe][momentum bin][theta bin], and the spline bases
+    // over the momentum and theta bin centers.
+    //
+    NaturalSplineBasis fMomentumBasis;
+    NaturalSplineBasis fThetaBasis;
+    std::vector<size_t> fUniverses{}; // fWeightArray rows that pass the smeared cross section check
+    std::vector<double> fSmearedXSec{};
+    std::vector<double> fMomentumWeights{};
+    std::vector<double> fThetaWeights{};
+    std::vector<double> fBinWeights{};
+
+    // Compare against the ROOT spline implementation when > 0
+    double fVerifyTolerance{};
 
      DECLARE_WEIGHTCALC(PrimaryHadronSWCentralSplineVariationWeightCalc)
   };
@@ -111,6 +220,14 @@ namespace evwgh {
     fScaleFactor                =   pset.get<double>("scale_factor");
     fSeed                       =   pset.get<double>("random_seed");
     fUseMBRands                 =   pset.get<bool>("use_MiniBooNE_random_numbers");
+    fVerifyTolerance            =   pset.get<double>("verify_tolerance", 0.);
+
+    if(fWeightCalc.find("MicroBooNE") != std::string::npos) fUseMicroBooNE = true;
+    else if(fWeightCalc.find("MiniBooNE") != std::string::npos) fUseMicroBooNE = false;
+    else{
+      throw art::Exception(art::errors::Configuration)
+	<< "weight_calculator must be \"MicroBooNE\" or \"MiniBooNE\"";
+    }
     
     ////////////////////////
     //
@@ -230,9 +347,64 @@ namespace evwgh {
     //covariance matrix, but simplifies the structure.
     fIsDecomposed = true;
     HARPLowerTriangluarCov = new TMatrixD(dc.GetU());  
+
+    PrecomputeUniverses();
        
   }//End Configure
 
+  ////
+  //   The smeared cross sections only depend on the universe, so smear them
+  //   once here instead of for every neutrino
+  ////
+  void PrimaryHadronSWCentralSplineVariationWeightCalc::PrecomputeUniverses()
+  {
+    int Ntbins = int(HARPthetaBounds.size()) - 1;
+    int Npbins = int(HARPmomentumBounds.size()) - 1;
+
+    fMomentumBasis = NaturalSplineBasis(BinCenters(HARPmomentumBounds));
+    fThetaBasis = NaturalSplineBasis(BinCenters(HARPthetaBounds));
+    fMomentumWeights.resize(Npbins);
+    fThetaWeights.resize(Ntbins);
+    fBinWeights.resize(Npbins*Ntbins);
+
+    if(fMode.find("multisim") == std::string::npos) return;
+
+    // Same analysis bin ordering as in the weight functions below
+    std::vector< double > HARPCrossSectionAnalysisBins(Npbins*Ntbins);
+    int anaBin = 0;
+    for(int pbin = 0; pbin < Npbins; pbin++){
+      for(int tbin = 0; tbin < Ntbins; tbin++){
+	HARPCrossSectionAnalysisBins[anaBin] = HARPXSec[0][pbin][tbin];
+	anaBin++;
+      }
+    }
+
+    // Universes with a negative smeared cross section are skipped, exactly
+    // as the per-event loop in GetWeight used to do
+    fUniverses.clear();
+    fSmearedXSec.clear();
+    for(size_t i = 0; i < fWeightArray.size() && int(fUniverses.size()) < fNmultisims; i++){
+      std::vector< double > smeared =
+	WeightCalc::MultiGaussianSmearing(HARPCrossSectionAnalysisBins, HARPLowerTriangluarCov, fIsDecomposed, fWeightArray[i]);
+
+      bool parameters_pass = true;
+      for(double xsec : smeared){
+	if(xsec < 0){ parameters_pass = false;}
+      }
+      if(!parameters_pass) continue;
+
+      fUniverses.push_back(i);
+      fSmearedXSec.insert(fSmearedXSec.end(), smeared.begin(), smeared.end());
+    }
+
+    if(int(fUniverses.size()) < fNmultisims){
+      throw art::Exception(art::errors::Configuration)
+	<< "Only " << fUniverses.size() << " of the " << fWeightArray.size()
+	<< " SW+Splines universes have non-negative cross sections, but "
+	<< fNmultisims << " were requested";
+    }
+  }
+
   std::vector<std::vector<double> > PrimaryHadronSWCentralSplineVariationWeightCalc::GetWeight(art::Event & e)
   {
 
@@ -273,33 +445,54 @@ namespace evwgh {
       //Let's make a weights based on the calculator you have requested       
       
       if(fMode.find("multisim") != std::string::npos){       
-	for (unsigned int i = 0; int(weight[inu].size()) < fNmultisims; i++) {
-
-	  if(fWeightCalc.find("MicroBooNE") != std::string::npos){
 
-	    //
-	    //This way we only have to call the WeightCalc once
-	    // 
-	    std::pair<bool, double> test_weight =
-	      MicroBooNEWeightCalc(fluxlist[inu], fWeightArray[i]);
-
-	    if(test_weight.first){
-	      weight[inu].push_back(test_weight.second);
-	    }
+	double momentum = 0;
+	double theta = 0;
+	double CV = CentralValue(fluxlist[inu], momentum, theta);
+
+	//
+	// The splines over momentum (at each theta bin) and then over theta are
+	// linear in the smeared cross sections, so the interpolated cross
+	// section of every universe is a weighted sum over the analysis bins
+	// with weights that only depend on this neutrino's parent
+	//
+	fMomentumBasis.Weights(momentum, fMomentumWeights.data());
+	fThetaBasis.Weights(theta, fThetaWeights.data());
+
+	size_t const Ntbins = fThetaWeights.size();
+	size_t const Nbins = fBinWeights.size();
+	for(size_t pbin = 0; pbin < fMomentumWeights.size(); pbin++){
+	  for(size_t tbin = 0; tbin < Ntbins; tbin++){
+	    fBinWeights[pbin*Ntbins + tbin] = fMomentumWeights[pbin]*fThetaWeights[tbin];
 	  }
-	  if(fWeightCalc.find("MiniBooNE") != std::string::npos){
+	}
 
-	    //
-	    //This way we only have to call the WeightCalc once
-	    // 
-	    std::pair<bool, double> test_weight =
-	      MiniBooNEWeightCalc(fluxlist[inu], fWeightArray[i]);
+	weight[inu].resize(fNmultisims);
+	for(int i = 0; i < fNmultisims; i++){
+	  double const* xsec = &fSmearedXSec[i*Nbins];
+	  double RW = 0;
+	  for(size_t bin = 0; bin < Nbins; bin++) RW += fBinWeights[bin]*xsec[bin];
 
-	    if(test_weight.first){
-	      weight[inu].push_back(test_weight.second);
+	  weight[inu][i] = FinalWeight(RW, CV);
+	}
+
+	//
+	// Optionally check the result against the ROOT spline implementation
+	//
+	if(fVerifyTolerance > 0){
+	  for(int i = 0; i < fNmultisims; i++){
+	    std::vector<double> const& rand = fWeightArray[fUniverses[i]];
+	    double reference = fUseMicroBooNE ?
+	      MicroBooNEWeightCalc(fluxlist[inu], rand).second :
+	      MiniBooNEWeightCalc(fluxlist[inu], rand).second;
+
+	    if(fabs(weight[inu][i] - reference) > fVerifyTolerance*std::max(1., fabs(reference))){
+	      throw art::Exception(art::errors::LogicError)
+		<< "SW+Splines weight " << weight[inu][i] << " in universe " << i
+		<< " differs from the reference weight " << reference;
 	    }
 	  }
-	}//Iterate through the number of universes      
+	}
       } // make sure we are multisiming
     }//Iterating through each neutrino 
 
@@ -312,10 +505,89 @@ namespace evwgh {
   ////////       Auxilary Functions
   //////////////////////////////
 
+  //// 
+  //   Sanford-Wang central value and the parent kinematics used for the
+  //   spline lookup (see the weight functions below for the details)
+  ////
+  double PrimaryHadronSWCentralSplineVariationWeightCalc::CentralValue(simb::MCFlux const& flux, double& momentum, double& theta) const{
+
+    double c1 = SWParam[0];
+    double c2 = SWParam[1];
+    double c3 = SWParam[2];
+    double c4 = SWParam[3];
+    double c5 = SWParam[4];
+    double c6 = SWParam[5];
+    double c7 = SWParam[6];
+    double c8 = SWParam[7];
+    double c9 = 1.0; // This isn't in the table but it is described in the text
+
+    double HadronMass;
+    if(fabs(fprimaryHad) == 211) HadronMass = 0.13957010; //Charged Pion
+    else{
+      throw art::Exception(art::errors::StdException)
+	<< "sanford-wang is only configured for charged pions ";
+    }
+
+    double HadronE  = sqrt(flux.ftpx*flux.ftpx + 
+			   flux.ftpy*flux.ftpy + 
+			   flux.ftpz*flux.ftpz + 
+			   HadronMass*HadronMass);
+    TLorentzVector HadronVec(flux.ftpx, flux.ftpy, flux.ftpz, HadronE);
+
+    theta = std::min(HadronVec.Theta(), 0.195);
+    momentum = HadronVec.P();
+
+    double ProtonMass = 0.9382720;
+    double ProtonPz = 8.89; //GeV
+    TLorentzVector ProtonVec(0, 0, ProtonPz, sqrt(ProtonPz*ProtonPz + ProtonMass*ProtonMass));
+
+    //Sanford-Wang Parameterization 
+    //  Eq 11 from PhysRevD.79.072002
+    double CV = c1 * pow(momentum, c2) * 
+      (1. - momentum/(ProtonVec.P() - c9)) *
+      exp(-1. * c3 * pow(momentum, c4) / pow(ProtonVec.P(), c5)) *
+      exp(-1. * c6 * theta *(momentum - c7 * ProtonVec.P() * pow(cos(theta), c8)));
+
+    // Check taken from MiniBooNE code (in single precision there)
+    bool above = fUseMicroBooNE ?
+      (momentum > (ProtonVec.P() - c9)) :
+      (float(momentum) > (float(ProtonVec.P()) - float(c9)));
+    if(above) CV = 0;
+
+    return CV;
+  }
+
+  //// 
+  //   Guards inherited from MiniBooNE code, see the weight functions below
+  ////
+  double PrimaryHadronSWCentralSplineVariationWeightCalc::FinalWeight(double RW, double CV) const{
+
+    double weight = 1; 
+
+    if(RW < 0 || CV < 0){
+      weight = 1;
+    }
+    else if(fabs(CV) < 1.e-12){
+      weight = 1;
+    }
+    else{
+      weight *= RW/CV;
+    }
+
+    if(weight < 0) weight = 0; 
+    if(weight > 30) weight = 30; 
+    if(!(std::isfinite(weight))){
+      if(fUseMicroBooNE) std::cout << "SW+Splines : Failed to get a finite weight" << std::endl; 	
+      weight = 30;
+    }
+
+    return weight;
+  }
+
   //// 
   //   Use the MiniBooNE Implementation to determine the weight 
   ////
-  std::pair< bool, double> PrimaryHadronSWCentralSplineVariationWeightCalc::MiniBooNEWeightCalc(simb::MCFlux flux, std::vector<double> rand){
+  std::pair< bool, double> PrimaryHadronSWCentralSplineVariationWeightCalc::MiniBooNEWeightCalc(simb::MCFlux const& flux, std::vector<double> const& rand){
     
     bool parameters_pass = true;
     
@@ -621,7 +893,7 @@ namespace evwgh {
   //// 
   //   Use the MicroBooNE Implementation to determine the weight 
   ////
-  std::pair<bool, double> PrimaryHadronSWCentralSplineVariationWeightCalc::MicroBooNEWeightCalc(simb::MCFlux flux, std::vector<double> rand){
+  std::pair<bool, double> PrimaryHadronSWCentralSplineVariationWeightCalc::MicroBooNEWeightCalc(simb::MCFlux const& flux, std::vector<double> const& rand){
 
     // 
     //  Largely built off the MiniBooNE code 
@@ -0,0 +1,44 @@
+#include "BatchedWeightCalc.h"
+
+#include "canvas/Persistency/Common/FindManyP.h"
+
+namespace evwgh {
+
+  EventTruth EventTruth::Extract(art::Event const& e, art::InputTag const& truthLabel,
+                                 bool readFlux, std::string const& particleLabel)
+  {
+    EventTruth truth;
+
+    auto truthHandle = e.getHandle<std::vector<simb::MCTruth>>(truthLabel);
+    if (!truthHandle) return truth;
+    truth.mctruths = truthHandle.product();
+
+    if (readFlux) {
+      if (auto fluxHandle = e.getHandle<std::vector<simb::MCFlux>>(truthLabel)) {
+        truth.mcfluxes = fluxHandle.product();
+      }
+    }
+
+    if (!particleLabel.empty()) {
+      const art::FindManyP<simb::MCParticle> truthParticles(truthHandle, e, particleLabel);
+      if (truthParticles.isValid()) {
+        truth.particles.resize(truthParticles.size());
+        for (size_t i = 0; i < truthParticles.size(); ++i) {
+          truth.particles[i] = truthParticles.at(i);
+        }
+      }
+    }
+
+    return truth;
+  }
+
+
+  std::vector<std::vector<double>> BatchedWeightCalc::GetWeight(art::Event& e)
+  {
+    const EventTruth truth = EventTruth::Extract(e, TruthLabel(), ReadsFlux(), ParticleLabel());
+    WeightMatrix weights;
+    FillWeights(truth, weights);
+    return weights.Release();
+  }
+
+}  // namespace evwgh
@@ -0,0 +1,113 @@
+/**
+ * \file BatchedWeightCalc.h
+ * \brief Universe-batched interface for EventWeight calculators
+ *
+ * A BatchedWeightCalc gets the truth information of an event through an
+ * EventTruth, which only holds the products the calculator reads, and
+ * writes the weights of all universes of each interaction into one row
+ * of a WeightMatrix. The larsim EventWeight driver only knows
+ * WeightCalc::GetWeight, which BatchedWeightCalc implements on top of
+ * FillWeights; the rows are handed over to the driver without a copy.
+ */
+
+#ifndef UBSIM_EVENTWEIGHT_CALCULATORS_BATCHEDWEIGHTCALC_H
+#define UBSIM_EVENTWEIGHT_CALCULATORS_BATCHEDWEIGHTCALC_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "art/Framework/Principal/Event.h"
+#include "canvas/Persistency/Common/Ptr.h"
+#include "canvas/Utilities/InputTag.h"
+#include "nusimdata/SimulationBase/MCFlux.h"
+#include "nusimdata/SimulationBase/MCParticle.h"
+#include "nusimdata/SimulationBase/MCTruth.h"
+#include "larsim/EventWeight/Base/WeightCalc.h"
+
+namespace evwgh {
+
+  /**
+   * \struct EventTruth
+   * \brief Truth inputs of one event for a batched calculator
+   *
+   * The pointers refer to the event's products and are null when the
+   * product is absent or was not requested.
+   */
+  struct EventTruth {
+    std::vector<simb::MCTruth> const* mctruths = nullptr;
+    std::vector<simb::MCFlux> const* mcfluxes = nullptr;   ///< same producer as the MCTruths
+    /// MCParticles associated to each MCTruth, only filled when requested
+    std::vector<std::vector<art::Ptr<simb::MCParticle>>> particles;
+
+    size_t NTruths() const { return mctruths ? mctruths->size() : 0; }
+
+    /// Read the truth products of an event. The MCTruth, and the MCFlux if
+    /// readFlux is set, come from truthLabel; the MCTruth-MCParticle
+    /// associations are only looked up when particleLabel is not empty.
+    static EventTruth Extract(art::Event const& e, art::InputTag const& truthLabel,
+                              bool readFlux = false, std::string const& particleLabel = "");
+  };
+
+
+  /**
+   * \class WeightMatrix
+   * \brief Weights of one calculator for one event
+   *
+   * Row i holds the weights of all universes for interaction (MCTruth) i,
+   * in the per-interaction vectors that WeightCalc::GetWeight returns.
+   */
+  class WeightMatrix {
+  public:
+    void Reset(size_t ntruths, size_t nuniverses, double fill = 1.)
+    {
+      fNUniverses = nuniverses;
+      fRows.assign(ntruths, std::vector<double>(nuniverses, fill));
+    }
+
+    size_t NTruths() const { return fRows.size(); }
+    size_t NUniverses() const { return fNUniverses; }
+
+    double* Row(size_t itruth) { return fRows[itruth].data(); }
+    const double* Row(size_t itruth) const { return fRows[itruth].data(); }
+
+    double& operator()(size_t itruth, size_t iuniv) { return fRows[itruth][iuniv]; }
+    double operator()(size_t itruth, size_t iuniv) const { return fRows[itruth][iuniv]; }
+
+    /// Hand the rows over as returned by WeightCalc::GetWeight, leaving the matrix empty
+    std::vector<std::vector<double>> Release()
+    {
+      fNUniverses = 0;
+      return std::exchange(fRows, {});
+    }
+
+  private:
+    size_t fNUniverses = 0;
+    std::vector<std::vector<double>> fRows;
+  };
+
+
+  /**
+   * \class BatchedWeightCalc
+   * \brief WeightCalc evaluated from an EventTruth into a WeightMatrix
+   */
+  class BatchedWeightCalc : public WeightCalc {
+  public:
+    /// Producer of the MCTruth (and MCFlux) products
+    virtual art::InputTag TruthLabel() const = 0;
+
+    /// Whether FillWeights reads the MCFlux products
+    virtual bool ReadsFlux() const { return false; }
+
+    /// Producer of the MCParticles associated to the MCTruths, empty if unused
+    virtual std::string ParticleLabel() const { return ""; }
+
+    /// Reset weights to the event's interactions and fill all universes
+    virtual void FillWeights(EventTruth const& truth, WeightMatrix& weights) = 0;
+
+    std::vector<std::vector<double>> GetWeight(art::Event& e) override;
+  };
+
+}  // namespace evwgh
+
+#endif  // UBSIM_EVENTWEIGHT_CALCULATORS_BATCHEDWEIGHTCALC_H
@@ -0,0 +1,265 @@
+/**
+ * \file BinnedLookup.h
+ * \brief Immutable binned lookup tables for the EventWeight calculators
+ *
+ * A BinnedLookup<N> holds the contents of an N-dimensional histogram in one
+ * flat array, with the same bin numbering as ROOT (bin 0 is the underflow,
+ * bins 1..n the regular bins, bin n+1 the overflow, x running fastest).
+ * Tables are built once at configure time, usually from a TH1/TH2/TH3, and
+ * are then only read, so one table can serve every universe of a
+ * calculator. Finding a bin is arithmetic on uniform axes and a binary
+ * search on variable ones, with no virtual calls.
+ */
+
+#ifndef UBSIM_EVENTWEIGHT_CALCULATORS_BINNEDLOOKUP_H
+#define UBSIM_EVENTWEIGHT_CALCULATORS_BINNEDLOOKUP_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "cetlib_except/exception.h"
+
+#include "TArrayD.h"
+#include "TAxis.h"
+#include "TH1.h"
+
+namespace evwgh {
+
+  /**
+   * \class BinnedAxis
+   * \brief Bin edges of one BinnedLookup axis
+   */
+  class BinnedAxis {
+  public:
+    BinnedAxis() = default;
+
+    /// Uniform axis of nbins bins between lo and hi
+    BinnedAxis(std::size_t nbins, double lo, double hi)
+      : fNBins(nbins), fLow(lo), fHigh(hi)
+    {
+      if (nbins == 0 || !(hi > lo)) {
+        throw cet::exception("BinnedAxis")
+          << "Invalid uniform axis: " << nbins << " bins in [" << lo << ", " << hi << ")\n";
+      }
+    }
+
+    /// Variable axis with the given (non-decreasing) bin edges
+    explicit BinnedAxis(std::vector<double> edges)
+      : fNBins(edges.empty() ? 0 : edges.size() - 1), fEdges(std::move(edges))
+    {
+      if (fEdges.empty() || !std::is_sorted(fEdges.begin(), fEdges.end())) {
+        throw cet::exception("BinnedAxis")
+          << "Variable axis needs a non-empty list of non-decreasing bin edges\n";
+      }
+      fLow = fEdges.front();
+      fHigh = fEdges.back();
+    }
+
+    /// Copy the binning of a ROOT axis
+    static BinnedAxis FromTAxis(const TAxis& axis)
+    {
+      const TArrayD* xbins = axis.GetXbins();
+      if (xbins->GetSize() == 0) {
+        return BinnedAxis(axis.GetNbins(), axis.GetXmin(), axis.GetXmax());
+      }
+      return BinnedAxis(std::vector<double>(xbins->GetArray(), xbins->GetArray() + xbins->GetSize()));
+    }
+
+    std::size_t NBins() const { return fNBins; }
+    bool IsUniform() const { return fEdges.empty(); }
+
+    /// Bin containing x, as TAxis::FindFixBin
+    std::size_t FindBin(double x) const
+    {
+      if (!IsUniform()) {
+        return std::upper_bound(fEdges.begin(), fEdges.end(), x) - fEdges.begin();
+      }
+      if (x < fLow) return 0;
+      if (!(x < fHigh)) return fNBins + 1;
+      std::size_t bin = 1 + std::size_t(fNBins * (x - fLow) / (fHigh - fLow));
+      return std::min(bin, fNBins);
+    }
+
+    /// Like FindBin, but values outside the axis go to the first/last bin
+    std::size_t FindBinClamped(double x) const
+    {
+      return std::clamp<std::size_t>(FindBin(x), 1, std::max<std::size_t>(fNBins, 1));
+    }
+
+    double LowEdge(std::size_t bin) const
+    {
+      if (!IsUniform()) return fEdges[std::clamp<std::size_t>(bin, 1, fNBins + 1) - 1];
+      return fLow + (double(bin) - 1.) * ((fHigh - fLow) / fNBins);
+    }
+
+    double Width(std::size_t bin) const { return LowEdge(bin + 1) - LowEdge(bin); }
+    double Center(std::size_t bin) const { return LowEdge(bin) + 0.5 * Width(bin); }
+
+    bool operator==(const BinnedAxis& other) const
+    {
+      return fNBins == other.fNBins && fLow == other.fLow && fHigh == other.fHigh &&
+             fEdges == other.fEdges;
+    }
+
+  private:
+    std::size_t fNBins = 0;
+    double fLow = 0.;
+    double fHigh = 0.;
+    std::vector<double> fEdges; ///< empty for uniform axes
+  };
+
+
+  /**
+   * \class BinnedLookup
+   * \brief N-dimensional table of bin contents, including under/overflow
+   */
+  template <std::size_t N>
+  class BinnedLookup {
+    static_assert(N >= 1 && N <= 3, "BinnedLookup supports 1 to 3 dimensions");
+
+  public:
+    BinnedLookup() = default;
+
+    /// Table over the given axes with every bin (under/overflow included) set to fill
+    explicit BinnedLookup(std::array<BinnedAxis, N> axes, double fill = 0.)
+      : fAxes(std::move(axes))
+    {
+      std::size_t ncells = 1;
+      for (std::size_t i = 0; i < N; ++i) {
+        fStrides[i] = ncells;
+        ncells *= fAxes[i].NBins() + 2;
+      }
+      fValues.assign(ncells, fill);
+    }
+
+    /// Copy the axes and contents of a histogram of dimension N
+    static BinnedLookup FromHist(const TH1& h)
+    {
+      if (std::size_t(h.GetDimension()) != N) {
+        throw cet::exception("BinnedLookup")
+          << "Histogram " << h.GetName() << " has dimension " << h.GetDimension()
+          << ", expected " << N << '\n';
+      }
+
+      const TAxis* haxes[3] = {h.GetXaxis(), h.GetYaxis(), h.GetZaxis()};
+      std::array<BinnedAxis, N> axes;
+      for (std::size_t i = 0; i < N; ++i) axes[i] = BinnedAxis::FromTAxis(*haxes[i]);
+
+      // Same global bin numbering as ROOT, so copy cell by cell
+      BinnedLookup table(std::move(axes));
+      for (std::size_t i = 0; i < table.fValues.size(); ++i) {
+        table.fValues[i] = h.GetBinContent(int(i));
+      }
+      return table;
+    }
+
+    const BinnedAxis& Axis(std::size_t i) const { return fAxes[i]; }
+    std::size_t Size() const { return fValues.size(); }
+
+    /// Flat index of the bin with the given per-axis bin numbers
+    template <typename... Bins>
+    std::size_t Index(Bins... bins) const
+    {
+      static_assert(sizeof...(Bins) == N, "wrong number of bins");
+      const std::size_t b[N] = {std::size_t(bins)...};
+      std::size_t index = 0;
+      for (std::size_t i = 0; i < N; ++i) index += b[i] * fStrides[i];
+      return index;
+    }
+
+    /// Flat index of the bin containing the point
+    template <typename... Xs>
+    std::size_t FindIndex(Xs... xs) const
+    {
+      static_assert(sizeof...(Xs) == N, "wrong number of coordinates");
+      const double x[N] = {double(xs)...};
+      std::size_t index = 0;
+      for (std::size_t i = 0; i < N; ++i) index += fAxes[i].FindBin(x[i]) * fStrides[i];
+      return index;
+    }
+
+    /// Flat index of the bin containing the point, clamped to the regular bins
+    template <typename... Xs>
+    std::size_t FindIndexClamped(Xs... xs) const
+    {
+      static_assert(sizeof...(Xs) == N, "wrong number of coordinates");
+      const double x[N] = {double(xs)...};
+      std::size_t index = 0;
+      for (std::size_t i = 0; i < N; ++i) index += fAxes[i].FindBinClamped(x[i]) * fStrides[i];
+      return index;
+    }
+
+    double operator[](std::size_t index) const { return fValues[index]; }
+    double& operator[](std::size_t index) { return fValues[index]; }
+
+    /// Content of the bin containing the point
+    template <typename... Xs>
+    double Value(Xs... xs) const { return fValues[FindIndex(xs...)]; }
+
+    /**
+     * Multilinear interpolation between bin centers, as TH1/TH2::Interpolate.
+     * Outside the first/last bin center the edge bin content is used.
+     */
+    template <typename... Xs>
+    double Interpolate(Xs... xs) const
+    {
+      static_assert(sizeof...(Xs) == N, "wrong number of coordinates");
+      const double x[N] = {double(xs)...};
+
+      std::size_t lo[N];
+      double frac[N];
+      for (std::size_t i = 0; i < N; ++i) {
+        const BinnedAxis& axis = fAxes[i];
+        std::size_t bin = axis.FindBinClamped(x[i]);
+        if (bin > 1 && x[i] < axis.Center(bin)) --bin;
+        if (axis.NBins() < 2 || x[i] <= axis.Center(1)) {
+          lo[i] = 1; frac[i] = 0.;
+        }
+        else if (x[i] >= axis.Center(axis.NBins())) {
+          lo[i] = axis.NBins() - 1; frac[i] = 1.;
+        }
+        else {
+          lo[i] = bin;
+          frac[i] = (x[i] - axis.Center(bin)) / (axis.Center(bin + 1) - axis.Center(bin));
+        }
+      }
+
+      double result = 0.;
+      for (std::size_t corner = 0; corner < (std::size_t(1) << N); ++corner) {
+        double w = 1.;
+        std::size_t index = 0;
+        for (std::size_t i = 0; i < N; ++i) {
+          bool up = (corner >> i) & 1;
+          w *= up ? frac[i] : 1. - frac[i];
+          index += (lo[i] + up) * fStrides[i];
+        }
+        if (w != 0.) result += w * fValues[index];
+      }
+      return result;
+    }
+
+    /// Apply f to every cell, e.g. to precompute a per-bin weight
+    template <typename F>
+    void Transform(F f)
+    {
+      for (double& v : fValues) v = f(v);
+    }
+
+    bool SameBinning(const BinnedLookup& other) const { return fAxes == other.fAxes; }
+
+  private:
+    std::array<BinnedAxis, N> fAxes;
+    std::array<std::size_t, N> fStrides{};
+    std::vector<double> fValues;
+  };
+
+  using BinnedLookup1D = BinnedLookup<1>;
+  using BinnedLookup2D = BinnedLookup<2>;
+  using BinnedLookup3D = BinnedLookup<3>;
+
+} // namespace evwgh
+
+#endif // UBSIM_EVENTWEIGHT_CALCULATORS_BINNEDLOOKUP_H
@@ -15,14 +15,21 @@
 #include "TFile.h"
 #include "TH1F.h"
 
+#include "ubsim/EventWeight/Calculators/BatchedWeightCalc.h"
+#include "ubsim/EventWeight/Calculators/BinnedLookup.h"
+
 namespace evwgh {
-  class FluxHistWeightCalc : public WeightCalc
+  class FluxHistWeightCalc : public BatchedWeightCalc
   {
   public:
     FluxHistWeightCalc() = default;
     void Configure(fhicl::ParameterSet const& pset,
                    CLHEP::HepRandomEngine& engine);
-    std::vector<std::vector<double> > GetWeight(art::Event & e);
+    art::InputTag TruthLabel() const override { return fGenieModuleLabel; }
+
+    bool ReadsFlux() const override { return true; }
+
+    void FillWeights(EventTruth const& truth, WeightMatrix& weight) override;
     
   private:    
     std::vector<double> fWeightArray{};
@@ -30,12 +37,12 @@ namespace evwgh {
     std::string fMode{};
     std::string fGenieModuleLabel{};
 
+    // RW/CV ratio binned in
     //         pi+-,k+-,k0,mu+- 
     //         |  numu, numubar, nue, nuebar 
     //         |  |   50MeV bins
     //         |  |   |
-    double fCV[4][4][200];
-    double fRW[4][4][200];
+    BinnedLookup3D fRatio;
     
     DECLARE_WEIGHTCALC(FluxHistWeightCalc)
   };
@@ -60,13 +67,17 @@ namespace evwgh {
     std::string ptype[] = {"pi", "k", "k0", "mu"};
     std::string ntype[] = {"numu", "numubar", "nue", "nuebar"};
 
+    // Energies past the last bin get a ratio of 1, i.e. no variation
+    fRatio = BinnedLookup3D({BinnedAxis(4, 0., 4.), BinnedAxis(4, 0., 4.), BinnedAxis(200, 0., 10.)}, 1.);
+
     TFile fcv(Form("%s",cvfile.c_str()));
     TFile frw(Form("%s",rwfile.c_str()));
     for (int iptyp=0;iptyp<4;iptyp++) {
       for (int intyp=0;intyp<4;intyp++) {
+	TH1F* hcv = dynamic_cast<TH1F*> (fcv.Get(Form("h_%s_%s",ptype[iptyp].c_str(),ntype[intyp].c_str())));
+	TH1F* hrw = dynamic_cast<TH1F*> (frw.Get(Form("h_%s_%s",ptype[iptyp].c_str(),ntype[intyp].c_str())));
 	for (int ibin=0;ibin<200;ibin++) {
-	  fCV[iptyp][intyp][ibin]=(dynamic_cast<TH1F*> (fcv.Get(Form("h_%s_%s",ptype[iptyp].c_str(),ntype[intyp].c_str()))))->GetBinContent(ibin+1);
-	  fRW[iptyp][intyp][ibin]=(dynamic_cast<TH1F*> (frw.Get(Form("h_%s_%s",ptype[iptyp].c_str(),ntype[intyp].c_str()))))->GetBinContent(ibin+1);
+	  fRatio[fRatio.Index(iptyp+1,intyp+1,ibin+1)]=hrw->GetBinContent(ibin+1)/hcv->GetBinContent(ibin+1);
 	}
       }
     }
@@ -81,33 +92,24 @@ namespace evwgh {
       for (double& weight : fWeightArray) weight = 1.;
   }
 
-  std::vector<std::vector<double> > FluxHistWeightCalc::GetWeight(art::Event & e)
+  void FluxHistWeightCalc::FillWeights(EventTruth const& truth, WeightMatrix& weight)
   {
     //calculate weight(s) here 
-    std::vector<std::vector<double> > weight;
-
-    // * MC flux information
-    auto mcfluxListHandle = e.getHandle< std::vector<simb::MCFlux> >(fGenieModuleLabel);
-    if (!mcfluxListHandle) {
-      return weight;
-    }
 
-    // * MC truth information
-    auto mctruthListHandle = e.getHandle< std::vector<simb::MCTruth> >(fGenieModuleLabel);
-    if (!mctruthListHandle) {
-      return weight;
+    // * MC flux and MC truth information
+    if (!truth.mcfluxes || !truth.mctruths) {
+      weight.Reset(0, fNmultisims);
+      return;
     }
 
-    std::vector<simb::MCFlux> const& fluxlist = *mcfluxListHandle;
-    std::vector<simb::MCTruth> const& mclist = *mctruthListHandle;
+    std::vector<simb::MCFlux> const& fluxlist = *truth.mcfluxes;
+    std::vector<simb::MCTruth> const& mclist = *truth.mctruths;
 
-    weight.resize(mclist.size());
+    weight.Reset(mclist.size(), fNmultisims);
     for (unsigned int inu=0;inu<mclist.size();inu++) {
-      weight[inu].resize(fNmultisims);
      
       int ptype=-9999;
       int ntype=-9999;
-      int bin=-9999;
       
       if ( fluxlist[inu].fptype==211 || fluxlist[inu].fptype==-211 ) ptype = 0;
       else if ( fluxlist[inu].fptype==321 || fluxlist[inu].fptype==-321 ) ptype = 1;
@@ -126,17 +128,16 @@ namespace evwgh {
       }
       
       double enu=mclist[inu].GetNeutrino().Nu().E();
-      bin=enu/0.05;     
+      double ratio = fRatio.Value(ptype,ntype,enu);
       for (int i=0;i<fNmultisims;i++) {
-	double test = 1-(1-fRW[ptype][ntype][bin]/fCV[ptype][ntype][bin])*fWeightArray[i];
+	double test = 1-(1-ratio)*fWeightArray[i];
 	
 	// Guards against inifinite weights
-	if(std::isfinite(test)){ weight[inu][i] = test;}
-	else{weight[inu][i] = 1;}
+	if(std::isfinite(test)){ weight(inu,i) = test;}
+	else{weight(inu,i) = 1;}
 
       }
     }
-    return weight;
   }
   REGISTER_WEIGHTCALC(FluxHistWeightCalc)
 }
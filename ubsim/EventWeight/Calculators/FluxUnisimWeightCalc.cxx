@@ -7,6 +7,9 @@
 #include "TH1F.h"
 #include "TFile.h"
 
+#include "ubsim/EventWeight/Calculators/BatchedWeightCalc.h"
+#include "ubsim/EventWeight/Calculators/BinnedLookup.h"
+
 #include "art/Framework/Services/Registry/ServiceHandle.h"
 #include "art/Framework/Services/Optional/RandomNumberGenerator.h"
 #include "art_root_io/TFileDirectory.h"
@@ -19,15 +22,19 @@
 #include "CLHEP/Random/RandGaussQ.h"
 
 namespace evwgh {
-  class FluxUnisimWeightCalc : public WeightCalc
+  class FluxUnisimWeightCalc : public BatchedWeightCalc
   {
 
   public:
     FluxUnisimWeightCalc() = default;
-    double MiniBooNEWeightCalc(double enu, int ptype, int ntype, int uni, bool noNeg);
-    double MicroBooNEWeightCalc(double enu, int ptype, int ntype, int uni, bool noNeg);
+    double MiniBooNEWeightCalc(std::size_t cell, int ptype, int ntype, int uni, bool noNeg);
+    double MicroBooNEWeightCalc(std::size_t cell, int ptype, int ntype, int uni, bool noNeg);
     void Configure(fhicl::ParameterSet const& p, CLHEP::HepRandomEngine& engine);
-    std::vector<std::vector<double> > GetWeight(art::Event & e);
+    art::InputTag TruthLabel() const override { return fGenieModuleLabel; }
+
+    bool ReadsFlux() const override { return true; }
+
+    void FillWeights(EventTruth const& truth, WeightMatrix& weight) override;
     std::vector< double > MiniBooNERandomNumbers(std::string);
 
 
@@ -51,9 +58,10 @@ namespace evwgh {
     //         |  ntype: numu, numubar, nue, nuebar 
     //         |  |   binnig: 50MeV
     //         |  |   |
-    double fCV[4][4][200];
-    double fRWpos[4][4][200];
-    double fRWneg[4][4][200];
+    // All three share the same binning, so one cell index serves all of them
+    BinnedLookup3D fCV;
+    BinnedLookup3D fRWpos;
+    BinnedLookup3D fRWneg;
 
     // This is for when there is only one systematic variation (i.e. skin depth)
     bool PosOnly{false};
@@ -117,13 +125,23 @@ namespace evwgh {
     // > The histograms are labled as
     //       'h5'+ptype[]+ntype[] 
 
+    //   Energies past the last bin are left with a zero CV, which gives a weight of 1
+    std::array<BinnedAxis, 3> axes = {BinnedAxis(4, 0., 4.), BinnedAxis(4, 0., 4.), BinnedAxis(200, 0., 10.)};
+    fCV = BinnedLookup3D(axes);
+    fRWpos = BinnedLookup3D(axes);
+    fRWneg = BinnedLookup3D(axes);
+
     for (int iptyp=0;iptyp<4;iptyp++) {
       for (int intyp=0;intyp<4;intyp++) {
+	TH1F* hcv = dynamic_cast<TH1F*> (fcv.Get(Form("h5%d%d",ptype[iptyp],ntype[intyp])));
+	TH1F* hrwpos = dynamic_cast<TH1F*> (frwpos.Get(Form("h5%d%d",ptype[iptyp],ntype[intyp])));
+	TH1F* hrwneg = dynamic_cast<TH1F*> (frwneg.Get(Form("h5%d%d",ptype[iptyp],ntype[intyp])));
 	for (int ibin=0;ibin<200;ibin++) { //Grab events from ibin+1 
 
-	  fCV[iptyp][intyp][ibin]=(dynamic_cast<TH1F*> (fcv.Get(Form("h5%d%d",ptype[iptyp],ntype[intyp]))))->GetBinContent(ibin+1);
-	  fRWpos[iptyp][intyp][ibin]=(dynamic_cast<TH1F*> (frwpos.Get(Form("h5%d%d",ptype[iptyp],ntype[intyp]))))->GetBinContent(ibin+1);
-	  fRWneg[iptyp][intyp][ibin]=(dynamic_cast<TH1F*> (frwneg.Get(Form("h5%d%d",ptype[iptyp],ntype[intyp]))))->GetBinContent(ibin+1);
+	  std::size_t cell = fCV.Index(iptyp+1, intyp+1, ibin+1);
+	  fCV[cell]=hcv->GetBinContent(ibin+1);
+	  fRWpos[cell]=hrwpos->GetBinContent(ibin+1);
+	  fRWneg[cell]=hrwneg->GetBinContent(ibin+1);
 
 	}// energy bin
       }//   type of neutrinos
@@ -155,38 +173,31 @@ namespace evwgh {
     }//Use LArSoft Randoms
 
   }
-  std::vector<std::vector<double> > FluxUnisimWeightCalc::GetWeight(art::Event & e)
+  void FluxUnisimWeightCalc::FillWeights(EventTruth const& truth, WeightMatrix& weight)
   {
 
     //Collect the event's Flux information
     //     This specifically deals with the neutrino type and parentage
-    art::Handle< std::vector<simb::MCFlux> > mcFluxHandle;
-    e.getByLabel(fGenieModuleLabel,mcFluxHandle);
-    std::vector<simb::MCFlux> const& fluxlist = *mcFluxHandle;
-
-    
     //Collect event's MC truth information
     //  This specifically deals with the neutrino energy and 
     //  counting how many interactions there are per event 
     //  (neutrino counting is CRITICALLY important for applying the 
     //   correct weights and not ending up with unphysical values)
-    art::Handle< std::vector<simb::MCTruth> > mctruthHandle;
-    e.getByLabel(fGenieModuleLabel,mctruthHandle);
-    std::vector<simb::MCTruth> const& mclist = *mctruthHandle;
+    if (!truth.mcfluxes || !truth.mctruths) {
+      throw cet::exception(__FUNCTION__) << GetName()<<"::No MCFlux/MCTruth found with label "<< fGenieModuleLabel << std::endl;
+    }
+    std::vector<simb::MCFlux> const& fluxlist = *truth.mcfluxes;
+    std::vector<simb::MCTruth> const& mclist = *truth.mctruths;
     
-    //Create a vector of weights for each neutrino 
-    std::vector< std::vector<double> > weight;
-    weight.resize(mclist.size());
+    //Create the weights of each neutrino, for the number of universes you want to generate
+    weight.Reset(mclist.size(), fNuni, 0.);
 
     // No neutrinos in this event
-    if(mclist.size() == 0) return weight;
+    if(mclist.size() == 0) return;
 
     //Iterate through each neutrino in the event
     for(unsigned int inu = 0; inu < mclist.size(); inu++){
 
-      //Resize vector to the number of universes you want to generate
-      weight[inu].resize(fNuni);
-      
       //containers for the parent and neutrino type information
       int ptype = std::numeric_limits<int>::max(); 
       int ntype = std::numeric_limits<int>::max();
@@ -213,26 +224,26 @@ namespace evwgh {
 
       // Collect neutrino energy
       double enu=mclist[inu].GetNeutrino().Nu().E();      
+      std::size_t cell = fCV.FindIndex(ptype, ntype, enu);
 
       //Let's make a weights based on the calculator you have requested 
       if(fMode.find("multisim") != std::string::npos){
 	for (int i=0;i<fNuni;i++) {
 
 	  if(fWeightCalc.find("MicroBooNE") != std::string::npos){
-	    weight[inu][i]=MicroBooNEWeightCalc(enu, ptype, ntype, i, PosOnly);
+	    weight(inu,i)=MicroBooNEWeightCalc(cell, ptype, ntype, i, PosOnly);
 	  }
 	  if(fWeightCalc.find("MiniBooNE") != std::string::npos){
-	    weight[inu][i]=MiniBooNEWeightCalc(enu, ptype, ntype, i, PosOnly);
+	    weight(inu,i)=MiniBooNEWeightCalc(cell, ptype, ntype, i, PosOnly);
 	  }
 
 	}//Iterate through the number of universes      
       }
     }
      
-    return weight;
   }
 
-  double FluxUnisimWeightCalc::MiniBooNEWeightCalc(double enu, int ptype, int ntype, int uni, bool noNeg)
+  double FluxUnisimWeightCalc::MiniBooNEWeightCalc(std::size_t cell, int ptype, int ntype, int uni, bool noNeg)
   {
     // 
     //   This is directly based on the MiniBooNE framework to 
@@ -242,7 +253,7 @@ namespace evwgh {
     //                                         
     double weight = 1;
     
-    int bin = int(enu/0.05); //convert energy (in GeV) into 50 MeV bin
+    const double cv = fCV[cell]; // CV of the 50 MeV energy bin
 
 
     //  This is based on:
@@ -252,11 +263,11 @@ namespace evwgh {
     //  pseudocode:
     //   Scaled Reweighting = ScaleFactor * Reweighting + ( 1 - ScaleFactor) * Central Value
     //
-    double scaled_pos = fScalePos*fRWpos[ptype][ntype][bin] + 
-      (1-fScalePos)*fCV[ptype][ntype][bin];
+    double scaled_pos = fScalePos*fRWpos[cell] + 
+      (1-fScalePos)*cv;
     
-    double scaled_neg = fScaleNeg*fRWneg[ptype][ntype][bin] + 
-      (1-fScaleNeg)*fCV[ptype][ntype][bin];
+    double scaled_neg = fScaleNeg*fRWneg[cell] + 
+      (1-fScaleNeg)*cv;
     
     // This is based on:
     //    http://cdcvs0.fnal.gov/cgi-bin/public-cvs/cvsweb-public.cgi/~checkout~/...
@@ -275,28 +286,28 @@ namespace evwgh {
     //
     
     if(fWeightArray[uni] > 0){      
-      double syst = fWeightArray[uni]*((scaled_pos/fCV[ptype][ntype][bin])-1);
+      double syst = fWeightArray[uni]*((scaled_pos/cv)-1);
       weight = 1 + (syst);
       
       if(scaled_pos == 0) weight = 1;
 
     }
     else if(noNeg == true){      
-      double syst = fWeightArray[uni]*( (2 - (scaled_pos/fCV[ptype][ntype][bin])) - 1);           
+      double syst = fWeightArray[uni]*( (2 - (scaled_pos/cv)) - 1);           
       weight = 1 - (syst);      
       
       if(scaled_pos == 0) weight = 1;
 
     }
     else{
-      double syst = fWeightArray[uni]*((scaled_neg/fCV[ptype][ntype][bin])-1);
+      double syst = fWeightArray[uni]*((scaled_neg/cv)-1);
       weight = 1 - (syst);    
 
       if(scaled_neg == 0) weight = 1;
 
     }
 
-    if(fabs(fCV[ptype][ntype][bin]) < 1.e-12) weight = 1;
+    if(fabs(cv) < 1.e-12) weight = 1;
 
     if(weight < 0) weight = 1; 
     if(weight > 30) weight = 30;
@@ -310,7 +321,7 @@ namespace evwgh {
     return weight;
   }
   
-  double FluxUnisimWeightCalc::MicroBooNEWeightCalc(double enu, int ptype, int ntype, int uni, bool noNeg)
+  double FluxUnisimWeightCalc::MicroBooNEWeightCalc(std::size_t cell, int ptype, int ntype, int uni, bool noNeg)
   {
 
     // 
@@ -324,7 +335,7 @@ namespace evwgh {
 
     double weight = 1;
     
-    int bin = int(enu/0.05); //convert energy (in GeV) into 50 MeV bin
+    const double cv = fCV[cell]; // CV of the 50 MeV energy bin
 
 
     //  This is based on:
@@ -334,11 +345,11 @@ namespace evwgh {
     //  pseudocode:
     //   Scaled Reweighting = ScaleFactor * Reweighting + ( 1 - ScaleFactor) * Central Value
     //
-    double scaled_pos = fScalePos*fRWpos[ptype][ntype][bin] + 
-      (1-fScalePos)*fCV[ptype][ntype][bin];
+    double scaled_pos = fScalePos*fRWpos[cell] + 
+      (1-fScalePos)*cv;
     
-    double scaled_neg = fScaleNeg*fRWneg[ptype][ntype][bin] + 
-      (1-fScaleNeg)*fCV[ptype][ntype][bin];
+    double scaled_neg = fScaleNeg*fRWneg[cell] + 
+      (1-fScaleNeg)*cv;
     
     // This is based on:
     //    http://cdcvs0.fnal.gov/cgi-bin/public-cvs/cvsweb-public.cgi/~checkout~/...
@@ -357,28 +368,28 @@ namespace evwgh {
     //
     
     if(fWeightArray[uni] > 0){      
-      double syst = fWeightArray[uni]*((scaled_pos/fCV[ptype][ntype][bin])-1);
+      double syst = fWeightArray[uni]*((scaled_pos/cv)-1);
       weight = 1 + (syst);
       
       if(scaled_pos == 0) weight = 1;
 
     }
     else if(noNeg == true){      
-      double syst = fWeightArray[uni]*( (2 - (scaled_pos/fCV[ptype][ntype][bin])) - 1);           
+      double syst = fWeightArray[uni]*( (2 - (scaled_pos/cv)) - 1);           
       weight = 1 - (syst);      
       
       if(scaled_pos == 0) weight = 1;
 
     }
     else{
-      double syst = fWeightArray[uni]*((scaled_neg/fCV[ptype][ntype][bin])-1);
+      double syst = fWeightArray[uni]*((scaled_neg/cv)-1);
       weight = 1 - (syst);    
 
       if(scaled_neg == 0) weight = 1;
 
     }
 
-    if(fabs(fCV[ptype][ntype][bin]) < 1.e-12) weight = 1;
+    if(fabs(cv) < 1.e-12) weight = 1;
 
     if(weight < 0) weight = 1; 
     if(weight > 30) weight = 30; 
@@ -6,8 +6,11 @@
  * Reweight events based on hadron reinteraction probabilities.
  */
 
+#include <algorithm>
 #include <map>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include "TDirectory.h"
 #include "TFile.h"
 #include "TH1D.h"
@@ -52,16 +55,21 @@ public:
   std::vector<std::vector<double> > GetWeight(art::Event& e);
 
 private:
+  G4Reweighter* UniverseReweighter(size_t j);
+
   std::string fMCParticleProducer;  //!< Label for the MCParticle producer
   std::string fMCTruthProducer;  //!< Label for the MCTruth producer
-  CLHEP::RandGaussQ* fGaussRandom;  //!< Random number generator
+  std::unique_ptr<CLHEP::RandGaussQ> fGaussRandom;  //!< Random number generator
   // std::map<int, ParticleDef> fParticles;  //!< Particles to reweight
   unsigned fNsims;  //!< Number of multisims
   int fPdg; //!< PDG value for particles that a given weight calculator should apply to. Note that for now this module can only handle weights for one particle species at a time.
   // float fXSUncertainty;  //!< Flat cross section uncertainty
   G4ReweighterFactory RWFactory; //!< Base class to handle all Geant4Reweighters (right now "all" means pi+, pi-, p)
-  G4Reweighter *theReweighter; //!< Geant4Reweighter -- this is what provides the weights
-  G4ReweightParameterMaker *ParMaker;
+  std::unique_ptr<G4Reweighter> theReweighter; //!< Geant4Reweighter -- this is what provides the weights (only used when universes are not cached)
+  std::unique_ptr<G4ReweightParameterMaker> ParMaker;
+  bool fCacheUniverses; //!< Build one reweighter per universe at configure time instead of resetting the histograms for every particle. Off by default: the memory of number_of_multisims reweighters has not been measured
+  std::vector<std::unique_ptr<G4Reweighter>> fUniverseReweighters; //!< One reweighter per universe, set up with that universe's histograms
+  std::vector<std::unique_ptr<TH1D>> fUniverseHists; //!< Per-universe copies of the parameter histograms used by fUniverseReweighters
   std::vector<std::map<std::string, double>> UniverseVals; //!< Vector of maps relating parameter name to value (defines parameter values that will be evaluated in universes). Each map should have one entry per parameter we are considering
 
   art::ServiceHandle < geo::Geometry > fGeometryService;
@@ -111,9 +119,10 @@ void Geant4WeightCalc::Configure(fhicl::ParameterSet const& p,
   fNsims = pset.get<int> ("number_of_multisims", 0);
   fPdg = pset.get<int> ("pdg_to_reweight");
   fDebug = pset.get<bool> ("debug",false);
+  fCacheUniverses = pset.get<bool> ("cache_universes",false);
 
   // Prepare random generator
-  fGaussRandom = new CLHEP::RandGaussQ(engine);
+  fGaussRandom = std::make_unique<CLHEP::RandGaussQ>(engine);
 
   // Get input files
   TFile FracsFile( FracsFileName.c_str(), "OPEN" );
@@ -122,8 +131,10 @@ void Geant4WeightCalc::Configure(fhicl::ParameterSet const& p,
   // Configure G4Reweighter
   bool totalonly = false;
   if (fPdg==2212) totalonly = true;
-  ParMaker = new G4ReweightParameterMaker( FitParSets, totalonly );
-  theReweighter = RWFactory.BuildReweighter(fPdg, &XSecFile, &FracsFile, ParMaker->GetFSHists(), ParMaker->GetElasticHist() );
+  ParMaker = std::make_unique<G4ReweightParameterMaker>( FitParSets, totalonly );
+  if (!fCacheUniverses){
+    theReweighter.reset( RWFactory.BuildReweighter(fPdg, &XSecFile, &FracsFile, ParMaker->GetFSHists(), ParMaker->GetElasticHist() ) );
+  }
 
   // Make output trees to save things for quick and easy validation
   art::ServiceHandle<art::TFileService> tfs;
@@ -221,6 +232,40 @@ void Geant4WeightCalc::Configure(fhicl::ParameterSet const& p,
 
   fNsims = UniverseVals.size();
   if (fDebug) std::cout << "Running mode: " << mode <<". Nsims = " << fNsims << std::endl;
+
+  // The reweighting histograms only depend on the universe, so set up one
+  // reweighter per universe here rather than recomputing the histograms for
+  // every particle in every event. Each reweighter gets its own copy of the
+  // histograms, since the parameter maker reuses its histograms for every
+  // call to SetNewVals.
+  if (fCacheUniverses){
+    for (size_t j=0; j<fNsims; j++){
+      ParMaker->SetNewVals(UniverseVals.at(j));
+
+      std::map<std::string, TH1D*> fs_hists;
+      for (auto const& fs_hist : ParMaker->GetFSHists()){
+        fUniverseHists.emplace_back( static_cast<TH1D*>( fs_hist.second->Clone() ) );
+        fUniverseHists.back()->SetDirectory(nullptr);
+        fs_hists[fs_hist.first] = fUniverseHists.back().get();
+      }
+      fUniverseHists.emplace_back( static_cast<TH1D*>( ParMaker->GetElasticHist()->Clone() ) );
+      fUniverseHists.back()->SetDirectory(nullptr);
+      TH1D* elastic_hist = fUniverseHists.back().get();
+
+      fUniverseReweighters.emplace_back( RWFactory.BuildReweighter(fPdg, &XSecFile, &FracsFile, fs_hists, elastic_hist) );
+    }
+  }
+}
+
+
+G4Reweighter* Geant4WeightCalc::UniverseReweighter(size_t j)
+{
+  if (fCacheUniverses) return fUniverseReweighters.at(j).get();
+
+  ParMaker->SetNewVals(UniverseVals.at(j));
+  theReweighter->SetNewHists(ParMaker->GetFSHists());
+  theReweighter->SetNewElasticHists(ParMaker->GetElasticHist());
+  return theReweighter.get();
 }
 
 
@@ -246,6 +291,11 @@ Geant4WeightCalc::GetWeight(art::Event& e) {
   e_elastic_weight.clear();
   e_elastic_weight.resize(truthHandle->size());
 
+  // Per-MCTruth lookup tables, reused between MCTruths
+  std::unordered_map<int, size_t> track_index;
+  std::vector<size_t> daughter_offsets;
+  std::vector<size_t> daughter_indices;
+
   // Loop over sets of MCTruth-associated particles
   for (size_t itruth=0; itruth<truthParticles.size(); itruth++) {
 
@@ -264,6 +314,26 @@ Geant4WeightCalc::GetWeight(art::Event& e) {
     // Loop over MCParticles in the event
     auto const& mcparticles = truthParticles.at(itruth);
 
+    // Map TrackIDs to positions in mcparticles (first match wins, as in a
+    // linear search) and store the daughters of particle i as a flat list:
+    // daughter_indices[daughter_offsets[i]] ... daughter_indices[daughter_offsets[i+1]-1]
+    track_index.clear();
+    track_index.reserve(mcparticles.size());
+    for (size_t i=0; i<mcparticles.size(); i++) {
+      track_index.emplace(mcparticles[i]->TrackId(), i);
+    }
+
+    daughter_offsets.assign(1, 0);
+    daughter_indices.clear();
+    for (size_t i=0; i<mcparticles.size(); i++) {
+      const simb::MCParticle& mcp = *mcparticles[i];
+      for (int i_d=0; i_d<mcp.NumberDaughters(); i_d++) {
+        auto it = track_index.find(mcp.Daughter(i_d));
+        if (it != track_index.end()) daughter_indices.push_back(it->second);
+      }
+      daughter_offsets.push_back(daughter_indices.size());
+    }
+
     for (size_t i=0; i<mcparticles.size(); i++) {
 
       // Reset things to be saved in the output tree for fast validation
@@ -301,7 +371,7 @@ Geant4WeightCalc::GetWeight(art::Event& e) {
         std::vector<double> trajpoint_PX;
         std::vector<double> trajpoint_PY;
         std::vector<double> trajpoint_PZ;
-        std::vector<int> elastic_indices;
+        std::vector<bool> trajpoint_elastic;
 
         //Get the list of processes from the true trajectory
         const std::vector< std::pair< size_t, unsigned char > > & processes = p.Trajectory().TrajectoryProcesses();
@@ -327,12 +397,9 @@ Geant4WeightCalc::GetWeight(art::Event& e) {
             trajpoint_PY.push_back( p.Py(i) );
             trajpoint_PZ.push_back( p.Pz(i) );
 
+            //Flag elastic scatters, indexed relative to the start of the reweightable steps
             auto itProc = process_map.find(i);
-            if( itProc != process_map.end() && itProc->second == "hadElastic" ){
-              //Push back the index relative to the start of the reweightable steps
-              elastic_indices.push_back( trajpoint_X.size() - 1 );
-              // if (fDebug) std::cout << "Elastic index: " << trajpoint_X.size() - 1 << std::endl;
-            }
+            trajpoint_elastic.push_back( itProc != process_map.end() && itProc->second == "hadElastic" );
 
           }
 
@@ -341,16 +408,10 @@ Geant4WeightCalc::GetWeight(art::Event& e) {
         // Now find daughters of the MCP
         std::vector<int> daughter_PDGs;
         std::vector<int> daughter_IDs;
-        for( int i_mcp = 0; i_mcp < p.NumberDaughters(); i_mcp++ ){
-          int daughterID = p.Daughter(i_mcp);
-          for (auto test_mcp : mcparticles){
-            if (test_mcp->TrackId() == daughterID){
-              int pid = test_mcp->PdgCode();
-              daughter_PDGs.push_back(pid);
-              daughter_IDs.push_back( test_mcp->TrackId() );
-              break;
-            }
-          }
+        for( size_t i_d = daughter_offsets[i]; i_d < daughter_offsets[i+1]; i_d++ ){
+          const simb::MCParticle& daughter = *mcparticles[ daughter_indices[i_d] ];
+          daughter_PDGs.push_back( daughter.PdgCode() );
+          daughter_IDs.push_back( daughter.TrackId() );
         } // end loop over daughters
 
         // --- Now that we have all the information about the track we need, here comes the reweighting part! --- //
@@ -359,22 +420,20 @@ Geant4WeightCalc::GetWeight(art::Event& e) {
         G4ReweightTraj theTraj(mcpID, p_PDG, 0, event_num, std::make_pair(0,0));
 
         //Create its set of G4ReweightSteps and add them to the Traj (note: this needs to be done once per MCParticle but will be valid for all weight calculations)
-        std::vector< G4ReweightStep* > allSteps;
-
         size_t nSteps = trajpoint_PX.size();
 
         if( nSteps < 2 ) continue;
 
-        p_nElasticScatters = elastic_indices.size();
+        p_nElasticScatters = std::count( trajpoint_elastic.begin(), trajpoint_elastic.end(), true );
         for( size_t istep = 1; istep < nSteps; ++istep ){
 
-          // if( istep == trajpoint_PX.size() - 1 && std::find( elastic_indices.begin(), elastic_indices.end(), j ) != elastic_indices.end() )
+          // if( istep == trajpoint_PX.size() - 1 && trajpoint_elastic[istep] )
           //   std::cout << "Warning: last step an elastic process" << std::endl;
 
           std::string proc = "default";
           if( istep == trajpoint_PX.size() - 1 )
             proc = EndProcess;
-          else if( std::find( elastic_indices.begin(), elastic_indices.end(), istep ) != elastic_indices.end() ){
+          else if( trajpoint_elastic[istep] ){
             proc = "hadElastic";
           }
 
@@ -405,15 +464,16 @@ Geant4WeightCalc::GetWeight(art::Event& e) {
             theTraj.SetEnergy( sqrt( preStepP[0]*preStepP[0] + preStepP[1]*preStepP[1] + preStepP[2]*preStepP[2] + mass*mass ) );
           }
 
-          G4ReweightStep * theStep = new G4ReweightStep( mcpID, p_PDG, 0, event_num, preStepP, postStepP, len, proc );
+          auto theStep = std::make_unique<G4ReweightStep>( mcpID, p_PDG, 0, event_num, preStepP, postStepP, len, proc );
           theStep->SetDeltaX( deltaX );
           theStep->SetDeltaY( deltaY );
           theStep->SetDeltaZ( deltaZ );
 
-          theTraj.AddStep( theStep );
+          // The trajectory takes ownership of its steps and children
+          theTraj.AddStep( theStep.release() );
 
           for( size_t k = 0; k < daughter_PDGs.size(); ++k ){
-            theTraj.AddChild( new G4ReweightTraj(daughter_IDs[k], daughter_PDGs[k], mcpID, event_num, std::make_pair(0,0) ) );
+            theTraj.AddChild( std::make_unique<G4ReweightTraj>(daughter_IDs[k], daughter_PDGs[k], mcpID, event_num, std::make_pair(0,0) ).release() );
           }
         } // end loop over nSteps (istep)
         p_track_length = theTraj.GetTotalLength();
@@ -446,18 +506,16 @@ Geant4WeightCalc::GetWeight(art::Event& e) {
         for (size_t j=0; j<weight[0].size(); j++) {
           float w, el_w;
 
-          // I think this is the only bit that needs to change for different universes -- all the above is jut about the track, which doesn't change based on universe
-          ParMaker->SetNewVals(UniverseVals.at(j));
-          theReweighter->SetNewHists(ParMaker->GetFSHists());
-          theReweighter->SetNewElasticHists(ParMaker->GetElasticHist());
+          // The reweighter is the only bit that changes for different universes -- all the above is just about the track, which doesn't change based on universe
+          G4Reweighter* theUniverseReweighter = UniverseReweighter(j);
 
           //Get the weight from the G4ReweightTraj
-          w = theReweighter->GetWeight( &theTraj );
+          w = theUniverseReweighter->GetWeight( &theTraj );
           // Total weight is the product of track weights in the event
           weight[itruth][j] *= std::max((float)0.0, w);
 
           // Do the same for elastic weight (should be 1 unless set to non-nominal )
-          el_w = theReweighter->GetElasticWeight( &theTraj );
+          el_w = theUniverseReweighter->GetElasticWeight( &theTraj );
           weight[itruth][j] *= std::max((float)0.0,el_w);
 
           // just for the output tree
@@ -17,6 +17,8 @@
  *     norm_scale           double  Additional normalization scale factor
  *
  *     event_filter         string  Event type ("ccqe" or "ccmec")
+ *     interpolate          bool    Interpolate the histogram between bin
+ *                                  centers (default false)
  *
  * The file is located based on the FW_SEARCH_PATH environment variable.
  *
@@ -40,11 +42,14 @@
 #include "larsim/EventWeight/Base/WeightCalcCreator.h"
 #include "larsim/EventWeight/Base/WeightCalc.h"
 
+#include "ubsim/EventWeight/Calculators/BatchedWeightCalc.h"
+#include "ubsim/EventWeight/Calculators/BinnedLookup.h"
+
 #include "CLHEP/Random/RandGaussQ.h"
 
 namespace evwgh {
 
-class HistogramWeightWeightCalc : public WeightCalc {
+class HistogramWeightWeightCalc : public BatchedWeightCalc {
 public:
   /** Constructor. */
   HistogramWeightWeightCalc();
@@ -53,8 +58,11 @@ public:
   void Configure(fhicl::ParameterSet const& p,
                  CLHEP::HepRandomEngine& engine);
 
-  /** Compute the list of weights. */
-  std::vector<std::vector<double> > GetWeight(art::Event& e);
+  /** Label of the MCTruth producer. */
+  art::InputTag TruthLabel() const override { return fGenieModuleLabel; }
+
+  /** Compute the weights of all universes. */
+  void FillWeights(EventTruth const& truth, WeightMatrix& weight) override;
 
 private:
   CLHEP::RandGaussQ* fGaussRandom;  //!< Random number generator
@@ -65,13 +73,14 @@ private:
   std::string fMode;  //!< Multisim vs. unisim mode
   std::string fEventFilter;  //!< Event filter string (see notes in header)
   bool fOneSided;  //!< One-sided, use upper half of a standard normal
-  TH2F* fRWHist;  //!< Reweighting histogram
+  bool fInterpolate;  //!< Interpolate between bin centers
+  BinnedLookup2D fRWHist;  //!< Reweighting histogram
 
   DECLARE_WEIGHTCALC(HistogramWeightWeightCalc)
 };
 
 
-HistogramWeightWeightCalc::HistogramWeightWeightCalc() : fRWHist(NULL) {}
+HistogramWeightWeightCalc::HistogramWeightWeightCalc() {}
 
 
 void HistogramWeightWeightCalc::Configure(fhicl::ParameterSet const& p,
@@ -95,8 +104,7 @@ void HistogramWeightWeightCalc::Configure(fhicl::ParameterSet const& p,
 
   TH2F* h = dynamic_cast<TH2F*>(histFile.Get(histObjectName.c_str()));
   assert(h);
-  fRWHist = dynamic_cast<TH2F*>(h->Clone("rwhist"));
-  fRWHist->SetDirectory(NULL);
+  fRWHist = BinnedLookup2D::FromHist(*h);
 
   histFile.Close();
 
@@ -105,6 +113,7 @@ void HistogramWeightWeightCalc::Configure(fhicl::ParameterSet const& p,
   fMode = pset.get<std::string>("mode");
   fEventFilter = pset.get<std::string>("event_filter");
   fOneSided = pset.get<bool>("one_sided", true);
+  fInterpolate = pset.get<bool>("interpolate", false);
   fNormScale = pset.get<double>("norm_scale");
   assert(fEventFilter == "ccqe" || fEventFilter == "ccmec");
 
@@ -127,23 +136,18 @@ void HistogramWeightWeightCalc::Configure(fhicl::ParameterSet const& p,
 }
 
 
-std::vector<std::vector<double> >
-HistogramWeightWeightCalc::GetWeight(art::Event& e) {
-  std::vector<std::vector<double> > weight;
+void HistogramWeightWeightCalc::FillWeights(EventTruth const& truth,
+                                            WeightMatrix& weight) {
+  weight.Reset(truth.NTruths(), fNmultisims, 1.0);
 
   // MC truth information
-  auto mctruthListHandle = e.getHandle<std::vector<simb::MCTruth> >(fGenieModuleLabel);
-  if (!mctruthListHandle) {
-    return weight;
+  if (!truth.mctruths) {
+    return;
   }
-  std::vector<simb::MCTruth> const& mclist = *mctruthListHandle;
-
-  weight.resize(mclist.size());
+  std::vector<simb::MCTruth> const& mclist = *truth.mctruths;
 
   // Loop through MCTruth neutrinos
   for (unsigned int inu=0; inu<mclist.size(); inu++) {
-    weight[inu].resize(fNmultisims, 1.0);
-
     // Truth-level event filtering and kinematics
     simb::MCNeutrino nu = mclist[inu].GetNeutrino();
     simb::MCParticle lep = nu.Lepton();
@@ -153,29 +157,33 @@ HistogramWeightWeightCalc::GetWeight(art::Event& e) {
     double q0 = nu.Nu().E() - lep.E();
     double q3 = (nu.Nu().Momentum().Vect() - lep.Momentum().Vect()).Mag();
 
+    bool selected =
+      (fEventFilter == "ccqe"  && ccnc == simb::kCC && mode == simb::kQE ) ||
+      (fEventFilter == "ccmec" && ccnc == simb::kCC && mode == simb::kMEC);
+
+    // The histogram value is the same in every universe
+    double w = 0;
+    if (selected) {
+      w = fInterpolate ? fRWHist.Interpolate(q3, q0) : fRWHist.Value(q3, q0);
+    }
+
     // Loop through multisim universes
     for (int i=0; i<fNmultisims; i++) {
-      if ((fEventFilter == "ccqe"  && ccnc == simb::kCC && mode == simb::kQE ) ||
-          (fEventFilter == "ccmec" && ccnc == simb::kCC && mode == simb::kMEC)) {
-        int xbin = fRWHist->GetXaxis()->FindBin(q3);
-        int ybin = fRWHist->GetYaxis()->FindBin(q0);
-        double w = fRWHist->GetBinContent(xbin, ybin);
-        weight[inu][i] = 1.0 - (1.0 - fNormScale * w) * fWeightArray[i];
-        weight[inu][i] = std::max(0.0, weight[inu][i]);
+      if (selected) {
+        weight(inu, i) = 1.0 - (1.0 - fNormScale * w) * fWeightArray[i];
+        weight(inu, i) = std::max(0.0, weight(inu, i));
 
         //std::cout << "Histogram weight: "
         //          << "type = " << fEventFilter << ", "
         //          << "q0 = " << q0 << ", "
         //          << "q3 = " << q3 << ", "
-        //          << "w = " << weight[inu][i] << std::endl;
+        //          << "w = " << weight(inu, i) << std::endl;
       }
       else {
-        weight[inu][i] = 1.0; 
+        weight(inu, i) = 1.0; 
       }
     }
   }
-
-  return weight;
 }
 
 REGISTER_WEIGHTCALC(HistogramWeightWeightCalc)
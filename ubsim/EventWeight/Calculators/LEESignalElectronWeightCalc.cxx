@@ -25,20 +25,24 @@
 #include "larsim/EventWeight/Base/WeightCalcCreator.h"
 #include "larsim/EventWeight/Base/WeightCalc.h"
 
+#include "ubsim/EventWeight/Calculators/BatchedWeightCalc.h"
+#include "ubsim/EventWeight/Calculators/BinnedLookup.h"
+
 namespace evwgh {
 
-class LEESignalElectronWeightCalc : public WeightCalc {
+class LEESignalElectronWeightCalc : public BatchedWeightCalc {
 public:
   LEESignalElectronWeightCalc() {}
 
   void Configure(fhicl::ParameterSet const& p, CLHEP::HepRandomEngine& );
 
-  std::vector<std::vector<double> > GetWeight(art::Event& e);
+  art::InputTag TruthLabel() const override { return fMCTruthProducer; }
+
+  void FillWeights(EventTruth const& truth, WeightMatrix& weight) override;
 
 private:
   art::InputTag fMCTruthProducer; //!< Label for MCTruth producer
-  std::vector<float>  fEnergyBinEdges; //!< list of the bin edges to use in energy
-  std::vector<double> fWeights; //!< List of the weights to apply per bin.
+  BinnedLookup1D fWeights; //!< Weight per energy bin, under/overflow included
 
   DECLARE_WEIGHTCALC(LEESignalElectronWeightCalc)
 };
@@ -51,38 +55,46 @@ void LEESignalElectronWeightCalc::Configure(fhicl::ParameterSet const& p,
   fhicl::ParameterSet const& pset = p.get<fhicl::ParameterSet>(GetName());
 
   fMCTruthProducer = pset.get<art::InputTag>("MCTruthProducer");
-  fEnergyBinEdges = pset.get< std::vector<float> >("EnergyBinEdges");
-  fWeights = pset.get< std::vector<double> >("Weights");
+  auto energyBinEdges = pset.get< std::vector<float> >("EnergyBinEdges");
+  auto weights = pset.get< std::vector<double> >("Weights");
+
+  if(energyBinEdges.size()+1!=weights.size())
+    throw cet::exception("LEESignalElectronWeightCalc")
+      << "BinEdges size is " << energyBinEdges.size()
+      << " so weights size should be " << energyBinEdges.size()+1
+      << " but it's " << weights.size() << ".";
 
-  if(fEnergyBinEdges.size()+1!=fWeights.size())
+  if(energyBinEdges.empty())
     throw cet::exception("LEESignalElectronWeightCalc")
-      << "BinEdges size is " << fEnergyBinEdges.size()
-      << " so weights size should be " << fEnergyBinEdges.size()+1
-      << " but it's " << fWeights.size() << ".";
+      << "Need at least one energy bin edge.";
 
-  for(size_t i_ebin=0; i_ebin<fEnergyBinEdges.size()-1; ++i_ebin)
-    if(fEnergyBinEdges[i_ebin]>fEnergyBinEdges[i_ebin+1])
+  for(size_t i_ebin=0; i_ebin<energyBinEdges.size()-1; ++i_ebin)
+    if(energyBinEdges[i_ebin]>energyBinEdges[i_ebin+1])
       throw cet::exception("LEESignalElectronWeightCalc")
 	<< "Energy bin edges are not monotonically increasing!";
+
+  // The first weight is the underflow and the last one the overflow, as in
+  // the lookup table
+  fWeights = BinnedLookup1D({BinnedAxis(std::vector<double>(energyBinEdges.begin(), energyBinEdges.end()))});
+  for(size_t i_ebin=0; i_ebin<weights.size(); ++i_ebin)
+    fWeights[i_ebin] = weights[i_ebin];
 }
   
-std::vector<std::vector<double> >
-LEESignalElectronWeightCalc::GetWeight(art::Event& e) {
+void LEESignalElectronWeightCalc::FillWeights(EventTruth const& truth,
+                                              WeightMatrix& weight) {
 
   // Get MCTruths in the event ...
-  art::Handle<std::vector<simb::MCTruth> > truthHandle;
-  e.getByLabel(fMCTruthProducer, truthHandle);
-  std::vector<simb::MCTruth> const& truthVec(*truthHandle);
+  if (!truth.mctruths)
+    throw cet::exception("LEESignalElectronWeightCalc")
+      << "No MCTruth found with label " << fMCTruthProducer.encode() << ".";
+  std::vector<simb::MCTruth> const& truthVec(*truth.mctruths);
 
-  // Initialize the vector of event weights
-  std::vector<std::vector<double> > weight(truthVec.size());
+  // Initialize the event weights to zero, one per MCTruth
+  weight.Reset(truthVec.size(), 1, 0.0);
 
   // Loop over the MCTruth objects...
   for (size_t itruth=0; itruth<truthVec.size(); ++itruth){
 
-    // Initialize weight vector to zero for this MCTruth
-    weight[itruth].resize(1, 0.0);
-
     auto const& mctruth = truthVec[itruth];
     if(mctruth.Origin()!=simb::Origin_t::kBeamNeutrino) continue;
 
@@ -92,17 +104,9 @@ LEESignalElectronWeightCalc::GetWeight(art::Event& e) {
     //if not electron or anti-electron neutrino, get out
     if(std::abs(nu.PdgCode())!=12) continue;
     
-    double nu_energy = nu.E();
-    size_t nu_ebin=0;
-    for(size_t i_ebin=0; i_ebin<fEnergyBinEdges.size(); ++i_ebin){
-      if(nu_energy<fEnergyBinEdges[i_ebin]) break;
-      ++nu_ebin;
-    }
-    weight[itruth][0] = fWeights[nu_ebin];
+    weight(itruth, 0) = fWeights.Value(nu.E());
     
   }
-
-  return weight;
 }
 
 REGISTER_WEIGHTCALC(LEESignalElectronWeightCalc)
@@ -6,6 +6,7 @@
  * Reweight events based on hadron reinteraction probabilities.
  */
 
+#include <algorithm>
 #include <map>
 #include <string>
 #include "TDirectory.h"
@@ -30,15 +31,22 @@
 #include "larsim/EventWeight/Base/WeightCalcCreator.h"
 #include "larsim/EventWeight/Base/WeightCalc.h"
 
+#include "ubsim/EventWeight/Calculators/BatchedWeightCalc.h"
+#include "ubsim/EventWeight/Calculators/BinnedLookup.h"
+
 namespace evwgh {
 
-class ReinteractionWeightCalc : public WeightCalc {
+class ReinteractionWeightCalc : public BatchedWeightCalc {
 public:
   ReinteractionWeightCalc() {}
 
   void Configure(fhicl::ParameterSet const& p, CLHEP::HepRandomEngine& engine);
 
-  std::vector<std::vector<double> > GetWeight(art::Event& e);
+  art::InputTag TruthLabel() const override { return fMCTruthProducer; }
+
+  std::string ParticleLabel() const override { return fMCParticleProducer; }
+
+  void FillWeights(EventTruth const& truth, WeightMatrix& weight) override;
 
   /**
    * \struct ParticleDef
@@ -70,14 +78,51 @@ public:
 
         xs->SetBinContent(j, v);
       }
+
+      // Keep the binning and interaction probabilities (including under-
+      // and overflow) in flat arrays for the per-particle lookup
+      int nbins = pint->GetNbinsX();
+      ke_axis = BinnedAxis::FromTAxis(*pint->GetXaxis());
+      pint_bins.resize(nbins+2);
+      for (int j=0; j<nbins+2; j++) {
+        pint_bins[j] = pint->GetBinContent(j);
+      }
+    }
+
+    /**
+     * Tabulate the survival probability up to the end of each KE bin for
+     * every universe, as [kebin][universe]. The products are accumulated in
+     * the same order and precision as the original per-particle loop, so
+     * the weights are unchanged.
+     */
+    void BuildSurvivalTable(float xs_uncertainty) {
+      size_t nsims = sigmas.size();
+      size_t nbins = pint_bins.size();
+      survival.assign(nbins * nsims, 1.0);
+
+      for (size_t j=0; j<nsims; j++) {
+        float wbin = 1.0 + xs_uncertainty * sigmas[j];
+        float sprob = 1.0;
+        for (size_t k=1; k<nbins; k++) {
+          float bin_xs = wbin * xs->GetBinContent(k);
+          sprob *= exp(-1.0 * bin_xs);
+          survival[k * nsims + j] = sprob;
+        }
+      }
     }
 
+    /** Bin of pint containing ke, with the TAxis::FindFixBin rules */
+    size_t FindBin(double ke) const { return ke_axis.FindBin(ke); }
+
     std::string name;  //!< String name
     int pdg;  //!< PDG code
     float par_sigma;  //!< Variation sigma set by user
     TH1D* pint;  //!< Interaction probability as a function of KE
     TH1D* xs;  //!< Derived effective cross section
     std::vector<double> sigmas;  //!< Sigmas for universes
+    BinnedAxis ke_axis;  //!< KE binning of pint
+    std::vector<double> pint_bins;  //!< Interaction probability per KE bin, including under/overflow
+    std::vector<float> survival;  //!< Survival probability per [KE bin][universe]
   };
 
 private:
@@ -153,27 +198,28 @@ void ReinteractionWeightCalc::Configure(fhicl::ParameterSet const& p,
       it.second.sigmas.push_back(it.second.par_sigma);
       fNsims = 1;
     }
+
+    it.second.BuildSurvivalTable(fXSUncertainty);
   }
 }
 
 
-std::vector<std::vector<double> >
-ReinteractionWeightCalc::GetWeight(art::Event& e) {
-  // Get MCParticles for each MCTruth in this event
-  art::Handle<std::vector<simb::MCTruth> > truthHandle;
-  e.getByLabel(fMCTruthProducer, truthHandle);
-  const art::FindManyP<simb::MCParticle> truthParticles(truthHandle, e, fMCParticleProducer);
-  assert(truthParticles.isValid());
+void ReinteractionWeightCalc::FillWeights(EventTruth const& truth,
+                                          WeightMatrix& weight) {
+  // MCParticles for each MCTruth in this event
+  auto const& truthParticles = truth.particles;
+  if (!truth.mctruths || truthParticles.size() != truth.NTruths()) {
+    throw cet::exception("ReinteractionWeightCalc")
+      << "No MCTruth-MCParticle associations for MCTruth " << fMCTruthProducer
+      << " and MCParticle " << fMCParticleProducer << '\n';
+  }
 
-  // Initialize the vector of event weights
-  std::vector<std::vector<double> > weight(truthHandle->size());
+  // Initialize the event weights
+  weight.Reset(truth.NTruths(), fNsims, 1.0);
 
   // Loop over sets of MCTruth-associated particles
   for (size_t itruth=0; itruth<truthParticles.size(); itruth++) {
 
-    // Initialize weight vector for this MCTruth
-    weight[itruth].resize(fNsims, 1.0);
-
     // Loop over MCParticles in the event
     auto const& mcparticles = truthParticles.at(itruth);
 
@@ -185,36 +231,32 @@ ReinteractionWeightCalc::GetWeight(art::Event& e) {
       bool interacted = (endProc.find("Inelastic") != std::string::npos);
 
       // Reweight particles under consideration
-      if (fParticles.find(pdg) != fParticles.end()) {
-        ParticleDef& def = fParticles[pdg];
-        int kebin = def.pint->FindBin(ke);
-
-        // Loop through universes
-        for (size_t j=0; j<weight[0].size(); j++) {
-          // Integrate a modified cross section to find a survival probability
-          float sprob = 1.0;
-          for (int k=1; k<kebin+1; k++) {
-            float wbin = 1.0 + fXSUncertainty * def.sigmas[j];
-            float xs = wbin * def.xs->GetBinContent(k);
-            sprob *= exp(-1.0 * xs);
+      auto itdef = fParticles.find(pdg);
+      if (itdef != fParticles.end()) {
+        const ParticleDef& def = itdef->second;
+        size_t kebin = def.FindBin(ke);
+        double pint = def.pint_bins[kebin];
+
+        // Survival probabilities of all universes for this KE bin
+        const float* sprob = &def.survival[kebin * fNsims];
+        double* w_out = weight.Row(itruth);
+
+        // Total weight is the product of track weights in the event
+        if (interacted) {
+          for (size_t j=0; j<fNsims; j++) {
+            float w = (1.0 - sprob[j]) / pint;
+            w_out[j] *= std::max((float)0.0, w);
           }
-
-          float w;
-          if (interacted) {
-            w = (1.0 - sprob) / def.pint->GetBinContent(kebin);
-          }
-          else {
-            w = sprob / (1.0 - def.pint->GetBinContent(kebin));
+        }
+        else {
+          for (size_t j=0; j<fNsims; j++) {
+            float w = sprob[j] / (1.0 - pint);
+            w_out[j] *= std::max((float)0.0, w);
           }
-
-          // Total weight is the product of track weights in the event
-          weight[itruth][j] *= std::max((float)0.0, w);
         }
       }
     }
   }
-
-  return weight;
 }
 
 REGISTER_WEIGHTCALC(ReinteractionWeightCalc)
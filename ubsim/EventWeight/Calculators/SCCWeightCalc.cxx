@@ -13,9 +13,12 @@
 #include "TFile.h"
 #include "TH1F.h"
 
+#include "ubsim/EventWeight/Calculators/BatchedWeightCalc.h"
+#include "ubsim/EventWeight/Calculators/BinnedLookup.h"
+
 namespace evwgh {
 
-  class SCCWeightCalc : public WeightCalc {  
+  class SCCWeightCalc : public BatchedWeightCalc {  
 
      public:
 
@@ -23,27 +26,10 @@ namespace evwgh {
        void Configure(fhicl::ParameterSet const& p,
                       CLHEP::HepRandomEngine& engine);
 
-       std::array<std::array<double, 101>, 1001> reweightingRatio; 
-       std::array<std::array<double, 101>, 1001> reweightingSigmas;
-       std::array<std::array<double, 101>, 1001> reweightingSigmas_e;
- 
-       std::array<double, 101> enumuon_nominal;
-       std::array<double, 1001> q2muon_nominal;
-       std::array<double, 101> binwidth_enu;
-       std::array<double, 1001> binwidth_q2;
-       std::array<std::array<double, 101>, 1001> xsecratio_nominal;
-       std::array<std::array<double, 101>, 1001>  xsecratio_Fv3;
-       std::array<std::array<double, 101>, 1001>  xsecratio_Fa3;
-       std::array<std::array<double, 101>, 1001>  xsecratio_Fv3Fa3;
-
-       std::array<std::array<double, 101>, 1001> xsecmuon_nominal;
-       std::array<std::array<double, 101>, 1001>  xsecmuon_Fv3;
-       std::array<std::array<double, 101>, 1001>  xsecmuon_Fa3;
-       std::array<std::array<double, 101>, 1001>  xsecmuon_Fv3Fa3;
-       std::array<std::array<double, 101>, 1001> xsece_nominal;
-       std::array<std::array<double, 101>, 1001>  xsece_Fv3;
-       std::array<std::array<double, 101>, 1001>  xsece_Fa3;
-       std::array<std::array<double, 101>, 1001>  xsece_Fv3Fa3;
+       // Muon and electron cross section shifts of the chosen knob from
+       // the nominal, binned in Enu [MeV] vs. Q2
+       BinnedLookup2D reweightingSigmas;
+       BinnedLookup2D reweightingSigmas_e;
   
        enum SCCRW{
          knominal,
@@ -56,7 +42,9 @@ namespace evwgh {
 
        void GetSCC();
 
-       std::vector<std::vector<double > > GetWeight(art::Event & e);
+       art::InputTag TruthLabel() const override { return fGenieModuleLabel; }
+
+       void FillWeights(EventTruth const& truth, WeightMatrix& weight) override;
 
      private:
 
@@ -155,180 +143,76 @@ namespace evwgh {
     TH2D* h_e_Fv3 = (TH2D*) inputf->Get("eFv3");
     TH2D* h_e_Fv3Fa3 = (TH2D*) inputf->Get("eFv3Fa3");
  
-    int NbinsX_muon_nominal=h_muon_nominal->GetNbinsX();
-    int NbinsX_muon_Fa3=h_muon_Fa3->GetNbinsX();
-    int NbinsX_muon_Fv3=h_muon_Fv3->GetNbinsX();
-    int NbinsX_muon_Fv3Fa3=h_muon_Fv3Fa3->GetNbinsX();
-
-    int NbinsY_muon_nominal=h_muon_nominal->GetNbinsY();
-    int NbinsY_muon_Fa3=h_muon_Fa3->GetNbinsY();
-    int NbinsY_muon_Fv3=h_muon_Fv3->GetNbinsY();
-    int NbinsY_muon_Fv3Fa3=h_muon_Fv3Fa3->GetNbinsY();
-
-    int NbinsX_e_nominal=h_e_nominal->GetNbinsX();
-    int NbinsX_e_Fa3=h_e_Fa3->GetNbinsX();
-    int NbinsX_e_Fv3=h_e_Fv3->GetNbinsX();
-    int NbinsX_e_Fv3Fa3=h_e_Fv3Fa3->GetNbinsX();
-
-    int NbinsY_e_nominal=h_e_nominal->GetNbinsY();
-    int NbinsY_e_Fa3=h_e_Fa3->GetNbinsY();
-    int NbinsY_e_Fv3=h_e_Fv3->GetNbinsY();
-    int NbinsY_e_Fv3Fa3=h_e_Fv3Fa3->GetNbinsY();
- 
-    std::cout<<"NbinsX_muon_nominal "<<NbinsX_muon_nominal<<std::endl;
-    std::cout<<"NbinsY_muon_nominal "<<NbinsY_muon_nominal<<std::endl;
+    std::cout<<"NbinsX_muon_nominal "<<h_muon_nominal->GetNbinsX()<<std::endl;
+    std::cout<<"NbinsY_muon_nominal "<<h_muon_nominal->GetNbinsY()<<std::endl;
 
-    int number_of_q2bins=NbinsY_muon_nominal;
-    int number_of_ebins=NbinsX_muon_nominal;
-    
-    std::cout<<number_of_q2bins<<std::endl;
-    std::cout<<number_of_ebins<<std::endl;
-    std::cout<<NbinsX_muon_nominal<<std::endl;
-    std::cout<<NbinsX_muon_Fv3<<std::endl;
-    std::cout<<NbinsX_muon_Fa3<<std::endl;
-    std::cout<<NbinsX_muon_Fv3Fa3<<std::endl;
-
-    std::cout<<NbinsY_muon_nominal<<std::endl;
-    std::cout<<NbinsY_muon_Fv3<<std::endl;
-    std::cout<<NbinsY_muon_Fa3<<std::endl;
-    std::cout<<NbinsY_muon_Fv3Fa3<<std::endl;
-
-    std::cout<<NbinsX_e_nominal<<std::endl;
-    std::cout<<NbinsX_e_Fv3<<std::endl;
-    std::cout<<NbinsX_e_Fa3<<std::endl;
-    std::cout<<NbinsX_e_Fv3Fa3<<std::endl;
-
-    std::cout<<NbinsY_e_nominal<<std::endl;
-    std::cout<<NbinsY_e_Fv3<<std::endl;
-    std::cout<<NbinsY_e_Fa3<<std::endl;
-    std::cout<<NbinsY_e_Fv3Fa3<<std::endl;
-
-
-    //get the bin content for each histogram
-    for(int ind_enu=0; ind_enu<=100; ind_enu++){
-      enumuon_nominal[ind_enu]=h_muon_nominal->GetXaxis()->GetBinCenter(ind_enu);
-      binwidth_enu[ind_enu]=h_muon_nominal->GetXaxis()->GetBinWidth(ind_enu);
-    }
-    for(auto ind_q2=0; ind_q2<=1000; ind_q2++){
-      q2muon_nominal[ind_q2]=h_muon_nominal->GetYaxis()->GetBinCenter(ind_q2);
-      binwidth_q2[ind_q2]=h_muon_nominal->GetYaxis()->GetBinWidth(ind_q2);
-    }  
-     
-    for(int ind_alg=0; ind_alg<4; ind_alg++){
-     for(int ind_enu_nom=0; ind_enu_nom<=number_of_ebins; ind_enu_nom++){
-       for(int ind_q2_nom=0; ind_q2_nom<=number_of_q2bins; ind_q2_nom++){
-         if(ind_alg==0){
-            xsecmuon_nominal[ind_enu_nom][ind_q2_nom]=h_muon_nominal->GetBinContent(ind_enu_nom,ind_q2_nom);
-         }
-         else if(ind_alg==1){
-            xsecmuon_Fv3[ind_enu_nom][ind_q2_nom]=h_muon_Fv3->GetBinContent(ind_enu_nom,ind_q2_nom); 
-         }
-         else if(ind_alg==2){
-            xsecmuon_Fa3[ind_enu_nom][ind_q2_nom]=h_muon_Fa3->GetBinContent(ind_enu_nom,ind_q2_nom); 
-         }
-         else if(ind_alg==3){
-            xsecmuon_Fv3Fa3[ind_enu_nom][ind_q2_nom]=h_muon_Fv3Fa3->GetBinContent(ind_enu_nom,ind_q2_nom); 
-         }       
-       }     
-     }
-    }
-    std::cout<<"xsecmuon_nominal[33][13]"<< xsecmuon_nominal[33][13]<<std::endl;
-    std::cout<<"xsecmuon_Fv3[33][13]"<< xsecmuon_Fv3[33][13]<<std::endl;
-
-     for(int ind_alg=0; ind_alg<4; ind_alg++){
-     for(int ind_enu_nom=0; ind_enu_nom<=number_of_ebins; ind_enu_nom++){
-       for(int ind_q2_nom=0; ind_q2_nom<=number_of_q2bins; ind_q2_nom++){
-         if(ind_alg==0){
-            xsece_nominal[ind_enu_nom][ind_q2_nom]=h_e_nominal->GetBinContent(ind_enu_nom,ind_q2_nom);
-         }
-         else if(ind_alg==1){
-            xsece_Fv3[ind_enu_nom][ind_q2_nom]=h_e_Fv3->GetBinContent(ind_enu_nom,ind_q2_nom); 
-         }
-         else if(ind_alg==2){
-            xsece_Fa3[ind_enu_nom][ind_q2_nom]=h_e_Fa3->GetBinContent(ind_enu_nom,ind_q2_nom); 
-         }
-         else if(ind_alg==3){
-            xsece_Fv3Fa3[ind_enu_nom][ind_q2_nom]=h_e_Fv3Fa3->GetBinContent(ind_enu_nom,ind_q2_nom); 
-         }       
-       }     
-     }
-    }
-
-    for(unsigned int i=0; i<4; ++i){
-       for(int j=0; j<= 100; j++){
-         for(int k=0; k<= 1000; k++){
-            if(i==0){xsecratio_nominal[j][k]=xsecmuon_nominal[j][k]/xsece_nominal[j][k];}
-            else if(i==1){xsecratio_Fv3[j][k]=xsecmuon_Fv3[j][k]/xsece_Fv3[j][k];}
-            else if(i==2){xsecratio_Fa3[j][k]=xsecmuon_Fa3[j][k]/xsece_Fa3[j][k];}
-            else if(i==3){xsecratio_Fv3Fa3[j][k]=xsecmuon_Fv3Fa3[j][k]/xsece_Fv3Fa3[j][k];}
-         }
-       }
-    }
-    std::cout<<"xsecratio in the  ....."<<std::endl;
-    std::cout<<xsecratio_nominal[70][50]<<" "<<xsecratio_Fv3[70][50]<<std::endl;
-    std::cout<<xsecratio_Fa3[70][50]<<" "<<xsecratio_Fv3Fa3[70][50]<<std::endl;
+    // Copy the histograms into flat lookup tables, so the event loop never
+    // goes back to ROOT. Without a variation knob the shifts stay zero,
+    // i.e. all weights are 1.
+    BinnedLookup2D xsecmuon_nominal = BinnedLookup2D::FromHist(*h_muon_nominal);
+    BinnedLookup2D xsece_nominal = BinnedLookup2D::FromHist(*h_e_nominal);
+    reweightingSigmas = BinnedLookup2D(std::array<BinnedAxis, 2>{xsecmuon_nominal.Axis(0), xsecmuon_nominal.Axis(1)});
+    reweightingSigmas_e = BinnedLookup2D(std::array<BinnedAxis, 2>{xsece_nominal.Axis(0), xsece_nominal.Axis(1)});
 
     std::cout<<"start to get tthe reweighting sigmas and reweighting ratios:  "<<std::endl;
     for(unsigned int i_reweightingKnob=0; i_reweightingKnob<xsecratiorwgh.size(); i_reweightingKnob++){   
 
-   
+      TH2D* h_muon = nullptr;
+      TH2D* h_e = nullptr;
       switch (xsecratiorwgh[i_reweightingKnob]){
        case knominal:
        break;
-       //--------------------------------------------------------------------------------------------
        case kFv3:
-       for(int jj=0; jj<=100; jj++){
-        for(int kk=0; kk<=1000; kk++){
-           reweightingRatio[jj][kk]=xsecratio_Fv3[jj][kk]; 
-           reweightingSigmas[jj][kk]=xsecmuon_Fv3[jj][kk]-xsecmuon_nominal[jj][kk];
-           reweightingSigmas_e[jj][kk]=xsece_Fv3[jj][kk]-xsece_nominal[jj][kk];
-        }
-       }
+       h_muon = h_muon_Fv3;
+       h_e = h_e_Fv3;
        break;
-       //-------------------------------------------------------------------------
        case kFa3:
-       for(int jj=0; jj<=100; jj++){
-        for(int kk=0; kk<=1000; kk++){
-           reweightingRatio[jj][kk]=xsecratio_Fa3[jj][kk]; 
-           reweightingSigmas[jj][kk]=xsecmuon_Fa3[jj][kk]-xsecmuon_nominal[jj][kk];
-           reweightingSigmas_e[jj][kk]=xsece_Fa3[jj][kk]-xsece_nominal[jj][kk];
-         }
-       }
+       h_muon = h_muon_Fa3;
+       h_e = h_e_Fa3;
        break;
-       //------------------------------------------------------------------------------
        case kFv3Fa3:
-       for(int jj=0; jj<=100; jj++){
-        for(int kk=0; kk<=1000; kk++){
-           reweightingRatio[jj][kk]=xsecratio_Fv3Fa3[jj][kk]; 
-           reweightingSigmas[jj][kk]=xsecmuon_Fv3Fa3[jj][kk]-xsecmuon_nominal[jj][kk];
-           reweightingSigmas_e[jj][kk]=xsece_Fv3Fa3[jj][kk]-xsece_nominal[jj][kk];
-         }
-       }
+       h_muon = h_muon_Fv3Fa3;
+       h_e = h_e_Fv3Fa3;
        break;
-       //----------------------------------------------------------------------------
-      } 
+      }
+      if (!h_muon) continue;
+
+      BinnedLookup2D xsecmuon = BinnedLookup2D::FromHist(*h_muon);
+      BinnedLookup2D xsece = BinnedLookup2D::FromHist(*h_e);
+      if (!xsecmuon.SameBinning(xsecmuon_nominal) || !xsece.SameBinning(xsece_nominal)) {
+        throw cet::exception(__FUNCTION__)
+          << GetName()
+          << ": SCC variation histograms are not binned like the nominal ones."
+          << std::endl;
+      }
+      for (size_t cell=0; cell<xsecmuon.Size(); cell++) {
+        reweightingSigmas[cell]=xsecmuon[cell]-xsecmuon_nominal[cell];
+      }
+      for (size_t cell=0; cell<xsece.Size(); cell++) {
+        reweightingSigmas_e[cell]=xsece[cell]-xsece_nominal[cell];
+      }
     }
     std::cout<<"end of getting reweighting sigmas and reweighting ratios  "<<std::endl;
+
+    inputf->Close();
+    delete inputf;
   }  
-  std::vector<std::vector<double> > SCCWeightCalc::GetWeight(art::Event & e)
+  void SCCWeightCalc::FillWeights(EventTruth const& truth, WeightMatrix& weight)
   { 
-    //returns a vector of weights for each neutrino interaction in the event
+    //fills the weights of each neutrino interaction in the event
     //
     std::cout << "NAME = " << GetName() << std::endl;
 
     //get the MC generator information out of the event       
-    //these are all handles to mc information.
-    auto mcTruthHandle = e.getHandle< std::vector<simb::MCTruth> >(fGenieModuleLabel);
-    if (!mcTruthHandle) {
-      return {};
+    if (!truth.mctruths) {
+      weight.Reset(0, fNmultisims, 0.);
+      return;
     }
-    std::vector<simb::MCTruth> const& mclist = *mcTruthHandle;
+    std::vector<simb::MCTruth> const& mclist = *truth.mctruths;
 
     //libo start
     //calculate weight(s) here 
-    std::vector<std::vector<double> > weight;
-    
-    weight.resize(mclist.size());
+    weight.Reset(mclist.size(), fNmultisims, 0.);
     //get the Q2 of GENIE truth and Enu of GENIE truth
         
     double _fnuPDGtruth;
@@ -339,8 +223,6 @@ namespace evwgh {
     
     for ( unsigned int inu=0; inu<mclist.size();inu++) {
       simb::MCTruth const& mctruth = mclist[inu];
-    
-      weight[inu].resize(fNmultisims);
 
       _fnuPDGtruth=mctruth.GetNeutrino().Nu().PdgCode();
       _fq2truth=mctruth.GetNeutrino().QSqr();
@@ -349,34 +231,28 @@ namespace evwgh {
       std::cout<<"Q2= "<<_fq2truth<<std::endl; 
       std::cout<<"Enu= "<<_fEnutruth<<std::endl;
 
-      for(int ind_multisim=0; ind_multisim<fNmultisims; ind_multisim++){
-
-        int Nbin_enu=int(_fEnutruth*1000/binwidth_enu[1])+1; 
-        if(Nbin_enu>100) Nbin_enu=100;
-
-        int Nbin_q2=int(_fq2truth/binwidth_q2[1])+1; 
-        if(Nbin_q2>1000) Nbin_q2=1000;
-
+      if (mctruth.GetNeutrino().Mode() != simb::kQE) {
+        std::cout << "Not QE, mode is " << mctruth.GetNeutrino().Mode() << std::endl;
+        std::fill(weight.Row(inu), weight.Row(inu) + fNmultisims, 1.);
+        continue;
+      }
 
-        std::cout<<"Nbin_q2= "<<Nbin_q2<<std::endl;
-        std::cout<<"Nbin_enu= "<<Nbin_enu<<std::endl; 
-        if (mctruth.GetNeutrino().Mode() == simb::kQE) {
-          if (_fnuPDGtruth ==14){
-            weight[inu][ind_multisim]=1-reweightingSigmas[Nbin_enu][Nbin_q2]*fWeightArray[ind_multisim];
-          }
-          if (_fnuPDGtruth ==12){
-            weight[inu][ind_multisim]=1-reweightingSigmas_e[Nbin_enu][Nbin_q2]*fWeightArray[ind_multisim];
-          }
-        }
-        else {
-          std::cout << "Not QE, mode is " << mctruth.GetNeutrino().Mode() << std::endl;
-          weight[inu][ind_multisim]=1;
-        }
+      // Same bin in every universe; energies and Q2 past the end of the
+      // histograms use the last bin
+      double sigma = 0;
+      if (_fnuPDGtruth ==14){
+        sigma=reweightingSigmas[reweightingSigmas.FindIndexClamped(_fEnutruth*1000, _fq2truth)];
+      }
+      else if (_fnuPDGtruth ==12){
+        sigma=reweightingSigmas_e[reweightingSigmas_e.FindIndexClamped(_fEnutruth*1000, _fq2truth)];
+      }
+      else continue;
 
+      for(int ind_multisim=0; ind_multisim<fNmultisims; ind_multisim++){
+        weight(inu, ind_multisim)=1-sigma*fWeightArray[ind_multisim];
       } //end of loop over multisims
 
     } //end of loop over inu mctruth
-    return weight;
 
   }
 
@@ -11,12 +11,15 @@
 //   by Marco Del Tutto <marco.deltutto@physics.ox.ac.uk>
 
 // Standard library includes
+#include <algorithm>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 
 // Framework includes
 #include "art/Framework/Principal/Event.h"
+#include "canvas/Persistency/Provenance/ProductID.h"
 #include "cetlib_except/exception.h"
 #include "messagefacility/MessageLogger/MessageLogger.h"
 
@@ -215,6 +218,162 @@ namespace {
   // then variation weights will be thrown around the tuned CV.
   std::set< std::string > CALC_NAMES_THAT_IGNORE_TUNED_CV = { "RootinoFix" };
 
+
+  // The genie::Messenger is a process-wide singleton shared by all of the
+  // GENIE weight calculators. Each calculator applies its own "quiet_mode"
+  // before it calls GENIE, and the thresholds are only rewritten when the
+  // mode differs from the one currently applied (reading the whisper
+  // configuration is not cheap).
+  std::mutex messenger_mutex;
+  int messenger_quiet_mode = -1; // -1 until a mode has been applied
+
+  void ApplyGENIEMessengerSettings( bool quiet_mode ) {
+    std::lock_guard< std::mutex > lock( messenger_mutex );
+    if ( messenger_quiet_mode == static_cast<int>(quiet_mode) ) return;
+    messenger_quiet_mode = quiet_mode;
+
+    genie::Messenger* messenger = genie::Messenger::Instance();
+
+    // By default, run GENIE reweighting in "quiet mode"
+    // (use the logging settings in the "whisper" configuration
+    // of the genie::Messenger class). The user can disable
+    // quiet mode using the boolean FHiCL parameter "quiet_mode"
+    if ( quiet_mode ) {
+      genie::utils::app_init::MesgThresholds( "Messenger_whisper.xml" );
+    }
+    else {
+      // If quiet mode isn't enabled, then print detailed debugging
+      // messages for GENIE reweighting
+      messenger->SetPriorityLevel( "ReW", log4cpp::Priority::DEBUG );
+    }
+
+    // Manually silence a couple of annoying GENIE logging messages
+    // that appear a lot when running reweighting. This is done
+    // whether or not "quiet mode" is enabled.
+    messenger->SetPriorityLevel( "TransverseEnhancementFFModel",
+      log4cpp::Priority::WARN );
+    messenger->SetPriorityLevel( "Nieves", log4cpp::Priority::WARN );
+  }
+
+
+  // Convert the MCTruth and GTruth objects from the event back into the
+  // original genie::EventRecord needed to compute the weights
+  std::unique_ptr< genie::EventRecord > MakeGENIEEvent(
+    const simb::MCTruth& mctruth, const simb::GTruth& gtruth )
+  {
+    std::unique_ptr< genie::EventRecord >
+      genie_event( evgb::RetrieveGHEP(mctruth, gtruth) );
+
+    // Set the final lepton kinetic energy and scattering cosine
+    // in the owned GENIE kinematics object. This is done during
+    // event generation but is not reproduced by evgb::RetrieveGHEP().
+    // Several new CCMEC weight calculators developed for MicroBooNE
+    // expect the variables to be set in this way (so that differential
+    // cross sections can be recomputed). Failing to set them results
+    // in inf and NaN weights.
+    // TODO: update evgb::RetrieveGHEP to do this instead.
+    genie::Interaction* interaction = genie_event->Summary();
+    genie::Kinematics* kine_ptr = interaction->KinePtr();
+
+    // Final lepton mass
+    double ml = interaction->FSPrimLepton()->Mass();
+    // Final lepton 4-momentum
+    const TLorentzVector& p4l = kine_ptr->FSLeptonP4();
+    // Final lepton kinetic energy
+    double Tl = p4l.E() - ml;
+    // Final lepton scattering cosine
+    double ctl = p4l.CosTheta();
+
+    kine_ptr->SetKV( kKVTl, Tl );
+    kine_ptr->SetKV( kKVctl, ctl );
+
+    return genie_event;
+  }
+
+
+  // Reconstructed GENIE event records for the current art event. All of the
+  // GENIE weight calculators in a job share one instance, so running several
+  // knob groups (e.g., the extra "All" universes) in a single job only calls
+  // evgb::RetrieveGHEP() once per neutrino. The records are owned copies and
+  // are reused only while the MCTruth and GTruth handles of the event are the
+  // same products (ProductID and address) as the ones they were built from.
+  class GENIEEventCache {
+    public:
+
+      using Records = std::vector< std::unique_ptr<genie::EventRecord> >;
+
+      std::shared_ptr< const Records > Get( art::Event& e,
+        const std::string& genie_module_label )
+      {
+        // Get the MC generator information out of the event
+        // These are both handles to MC information.
+        art::Handle< std::vector<simb::MCTruth> > mcTruthHandle;
+        art::Handle< std::vector<simb::GTruth> > gTruthHandle;
+
+        // Actually go and get the stuff
+        e.getByLabel( genie_module_label, mcTruthHandle );
+        e.getByLabel( genie_module_label, gTruthHandle );
+
+        const Key key{ e.id(), mcTruthHandle.id(), mcTruthHandle.product(),
+          gTruthHandle.id(), gTruthHandle.product() };
+
+        std::lock_guard< std::mutex > lock( fMutex );
+        if ( fRecords && key == fKey ) return fRecords;
+
+        std::vector< art::Ptr<simb::MCTruth> > mclist;
+        art::fill_ptr_vector( mclist, mcTruthHandle );
+
+        std::vector< art::Ptr<simb::GTruth > > glist;
+        art::fill_ptr_vector( glist, gTruthHandle );
+
+        auto records = std::make_shared< Records >();
+        records->reserve( mclist.size() );
+        for ( size_t v = 0u; v < mclist.size(); ++v ) {
+          records->push_back( MakeGENIEEvent(*mclist[v], *glist[v]) );
+        }
+
+        fKey = key;
+        fRecords = records;
+        return fRecords;
+      }
+
+    private:
+
+      // Identity of the products the records were built from
+      struct Key {
+        art::EventID event;
+        art::ProductID mctruth_id;
+        const void* mctruth = nullptr;
+        art::ProductID gtruth_id;
+        const void* gtruth = nullptr;
+
+        bool operator==( const Key& other ) const {
+          return event == other.event
+            && mctruth_id == other.mctruth_id && mctruth == other.mctruth
+            && gtruth_id == other.gtruth_id && gtruth == other.gtruth;
+        }
+      };
+
+      std::mutex fMutex;
+      Key fKey;
+      std::shared_ptr< const Records > fRecords;
+  };
+
+  // Every calculator holds a reference to the cache, so the event records
+  // are released together with the last GENIE weight calculator
+  std::shared_ptr< GENIEEventCache > SharedGENIEEventCache() {
+    static std::mutex cache_mutex;
+    static std::weak_ptr< GENIEEventCache > cache;
+
+    std::lock_guard< std::mutex > lock( cache_mutex );
+    std::shared_ptr< GENIEEventCache > result = cache.lock();
+    if ( !result ) {
+      result = std::make_shared< GENIEEventCache >();
+      cache = result;
+    }
+    return result;
+  }
+
 } // anonymous namespace
 
 namespace evwgh {
@@ -234,7 +393,26 @@ namespace evwgh {
       void SetupWeightCalculators(genie::rew::GReWeight& rw,
         const std::map<std::string, int>& modes_to_use);
 
-      std::vector< genie::rew::GReWeight > reweightVector;
+      // Returns the reweighter in the given slot, constructing it on first
+      // use and setting its knobs to the values for the requested universe
+      genie::rew::GReWeight& Reweighter( size_t slot, size_t universe );
+
+      // Reweighters are only built once weights are requested. If fewer
+      // slots than universes are configured, the slots are reused for
+      // successive batches of universes (trading CPU time for memory).
+      std::vector< std::unique_ptr<genie::rew::GReWeight> > fReweighters;
+      std::vector< size_t > fSlotUniverse;
+
+      // Universes whose reweighter settings have been printed
+      std::vector< bool > fPrintedUniverse;
+
+      // Knob settings for every universe, indexed as [knob][universe]
+      std::vector< genie::rew::GSyst_t > fKnobsToUse;
+      std::vector< std::vector<double> > fReweightingSigmas;
+      std::map< std::string, int > fModesToUse;
+      size_t fNumUniverses;
+
+      std::shared_ptr< GENIEEventCache > fEventCache;
 
       std::string fGenieModuleLabel;
 
@@ -249,34 +427,15 @@ namespace evwgh {
   void UBGenieWeightCalc::Configure(const fhicl::ParameterSet& p,
     CLHEP::HepRandomEngine& engine)
   {
-    genie::Messenger* messenger = genie::Messenger::Instance();
-
-    // By default, run GENIE reweighting in "quiet mode"
-    // (use the logging settings in the "whisper" configuration
-    // of the genie::Messenger class). The user can disable
-    // quiet mode using the boolean FHiCL parameter "quiet_mode"
     fQuietMode = p.get<bool>( "quiet_mode", true );
-    if ( fQuietMode ) {
-      genie::utils::app_init::MesgThresholds( "Messenger_whisper.xml" );
-    }
-    else {
-      // If quiet mode isn't enabled, then print detailed debugging
-      // messages for GENIE reweighting
-      messenger->SetPriorityLevel( "ReW", log4cpp::Priority::DEBUG );
+    ApplyGENIEMessengerSettings( fQuietMode );
 
-      MF_LOG_INFO("GENIEWeightCalc") << "Configuring GENIE weight"
-        << " calculator " << this->GetName();
-    }
-
-    // Manually silence a couple of annoying GENIE logging messages
-    // that appear a lot when running reweighting. This is done
-    // whether or not "quiet mode" is enabled.
-    messenger->SetPriorityLevel( "TransverseEnhancementFFModel",
-      log4cpp::Priority::WARN );
-    messenger->SetPriorityLevel( "Nieves", log4cpp::Priority::WARN );
+    if ( !fQuietMode ) MF_LOG_INFO("GENIEWeightCalc") << "Configuring GENIE"
+      << " weight calculator " << this->GetName();
 
     // Global Config
     fGenieModuleLabel = p.get<std::string>( "genie_module_label" );
+    fEventCache = SharedGENIEEventCache();
 
     // Parameter central values from a table in the global config
     // Keys are GENIE knob names, values are knob settings that correspond to a tuned CV
@@ -371,14 +530,6 @@ namespace evwgh {
       num_universes = 1u;
     }
 
-    // Create one default-constructed genie::rew::GReWeight object per universe
-    reweightVector.resize( num_universes );
-
-    // Set up the weight calculators for each universe
-    for ( auto& rwght : reweightVector ) {
-      this->SetupWeightCalculators( rwght, modes_to_use );
-    }
-
     // Prepare sigmas
     size_t num_usable_knobs = knobs_to_use.size();
     std::vector< std::vector<double> > reweightingSigmas( num_usable_knobs );
@@ -461,90 +612,100 @@ namespace evwgh {
     // TODO: deal with parameters that have a priori bounds (e.g., FFCCQEVec,
     // which can vary on the interval [0,1])
 
-    // Set up the knob values for each universe
-    for ( size_t u = 0; u < reweightVector.size(); ++u ) {
+    fKnobsToUse = knobs_to_use;
+    fReweightingSigmas = reweightingSigmas;
+    fModesToUse = modes_to_use;
+    fNumUniverses = num_universes;
+
+    // Number of genie::rew::GReWeight objects kept alive at once. By default
+    // every universe gets its own one. A smaller value bounds the memory used
+    // by this calculator at the cost of reconfiguring the reweighters for
+    // each batch of universes in every event.
+    size_t max_live = pset.get<size_t>( "max_live_reweighters", 0u );
+    if ( max_live == 0u || max_live > num_universes ) max_live = num_universes;
+
+    fReweighters.resize( max_live );
+    fSlotUniverse.assign( max_live, num_universes );
+    fPrintedUniverse.assign( num_universes, false );
+  }
+
+  genie::rew::GReWeight& UBGenieWeightCalc::Reweighter( size_t slot,
+    size_t universe )
+  {
+    auto& rwght = fReweighters.at( slot );
+    if ( !rwght ) {
+      rwght = std::make_unique< genie::rew::GReWeight >();
+      this->SetupWeightCalculators( *rwght, fModesToUse );
+    }
+    if ( fSlotUniverse[ slot ] == universe ) return *rwght;
 
-      auto& rwght = reweightVector.at( u );
-      genie::rew::GSystSet& syst = rwght.Systematics();
+    // Set up the knob values for this universe
+    genie::rew::GSystSet& syst = rwght->Systematics();
 
-      for ( unsigned int k = 0; k < knobs_to_use.size(); ++k ) {
-        genie::rew::GSyst_t knob = knobs_to_use.at( k );
+    for ( unsigned int k = 0; k < fKnobsToUse.size(); ++k ) {
+      genie::rew::GSyst_t knob = fKnobsToUse.at( k );
 
-        double twk_dial_value = reweightingSigmas.at( k ).at( u );
-        syst.Set( knob, twk_dial_value );
+      double twk_dial_value = fReweightingSigmas.at( k ).at( universe );
+      syst.Set( knob, twk_dial_value );
 
-        if ( !fQuietMode ) {
-          MF_LOG_INFO("GENIEWeightCalc") << "In universe #" << u << ", knob #" << k
-            << " (" << genie::rew::GSyst::AsString( knob ) << ") was set to"
-            << " the value " << twk_dial_value;
-        }
-      } // loop over tweaked knobs
+      if ( !fQuietMode ) {
+        MF_LOG_INFO("GENIEWeightCalc") << "In universe #" << universe << ", knob #" << k
+          << " (" << genie::rew::GSyst::AsString( knob ) << ") was set to"
+          << " the value " << twk_dial_value;
+      }
+    } // loop over tweaked knobs
 
-      rwght.Reconfigure();
-      rwght.Print();
-    } // loop over universes
+    rwght->Reconfigure();
 
+    // As when every reweighter was set up in Configure(), print the settings
+    // once per universe (the Messenger thresholds decide what is shown), not
+    // every time a slot is reconfigured for a new batch
+    if ( !fPrintedUniverse[ universe ] ) {
+      rwght->Print();
+      fPrintedUniverse[ universe ] = true;
+    }
+
+    fSlotUniverse[ slot ] = universe;
+    return *rwght;
   }
 
   // Returns a vector of weights for each neutrino interaction in the event
   std::vector<std::vector<double> > UBGenieWeightCalc::GetWeight(art::Event & e)
   {
-    // Get the MC generator information out of the event
-    // These are both handles to MC information.
-    art::Handle< std::vector<simb::MCTruth> > mcTruthHandle;
-    art::Handle< std::vector<simb::GTruth> > gTruthHandle;
-
-    // Actually go and get the stuff
-    e.getByLabel( fGenieModuleLabel, mcTruthHandle );
-    e.getByLabel( fGenieModuleLabel, gTruthHandle );
+    // Other GENIE weight calculators may run with a different quiet_mode
+    ApplyGENIEMessengerSettings( fQuietMode );
 
-    std::vector< art::Ptr<simb::MCTruth> > mclist;
-    art::fill_ptr_vector( mclist, mcTruthHandle );
+    // The reconstructed event records are shared with the other GENIE weight
+    // calculators in the job
+    std::shared_ptr< const GENIEEventCache::Records >
+      genie_events = fEventCache->Get( e, fGenieModuleLabel );
 
-    std::vector< art::Ptr<simb::GTruth > > glist;
-    art::fill_ptr_vector( glist, gTruthHandle );
-
-    size_t num_neutrinos = mclist.size();
-    size_t num_knobs = reweightVector.size();
+    size_t num_neutrinos = genie_events->size();
+    size_t num_slots = fReweighters.size();
 
     // Calculate weight(s) here
-    std::vector< std::vector<double> > weights( num_neutrinos );
-    for ( size_t v = 0u; v < num_neutrinos; ++v ) {
-
-      // Convert the MCTruth and GTruth objects from the event
-      // back into the original genie::EventRecord needed to
-      // compute the weights
-      std::unique_ptr< genie::EventRecord >
-        genie_event( evgb::RetrieveGHEP(*mclist[v], *glist[v]) );
-
-      // Set the final lepton kinetic energy and scattering cosine
-      // in the owned GENIE kinematics object. This is done during
-      // event generation but is not reproduced by evgb::RetrieveGHEP().
-      // Several new CCMEC weight calculators developed for MicroBooNE
-      // expect the variables to be set in this way (so that differential
-      // cross sections can be recomputed). Failing to set them results
-      // in inf and NaN weights.
-      // TODO: update evgb::RetrieveGHEP to do this instead.
-      genie::Interaction* interaction = genie_event->Summary();
-      genie::Kinematics* kine_ptr = interaction->KinePtr();
-
-      // Final lepton mass
-      double ml = interaction->FSPrimLepton()->Mass();
-      // Final lepton 4-momentum
-      const TLorentzVector& p4l = kine_ptr->FSLeptonP4();
-      // Final lepton kinetic energy
-      double Tl = p4l.E() - ml;
-      // Final lepton scattering cosine
-      double ctl = p4l.CosTheta();
-
-      kine_ptr->SetKV( kKVTl, Tl );
-      kine_ptr->SetKV( kKVctl, ctl );
-
-      // All right, the event record is fully ready. Now ask the GReWeight
-      // objects to compute the weights.
-      weights[v].resize( num_knobs );
-      for (size_t k = 0u; k < num_knobs; ++k ) {
-        weights[v][k] = reweightVector.at( k ).CalcWeight( *genie_event );
+    std::vector< std::vector<double> > weights( num_neutrinos,
+      std::vector<double>(fNumUniverses) );
+    if ( num_neutrinos == 0u ) return weights;
+
+    for ( size_t first = 0u; first < fNumUniverses; first += num_slots ) {
+      size_t last = std::min( first + num_slots, fNumUniverses );
+
+      // Set up the reweighters of this batch of universes
+      for ( size_t u = first; u < last; ++u ) this->Reweighter( u - first, u );
+
+      for ( size_t v = 0u; v < num_neutrinos; ++v ) {
+        const genie::EventRecord& event = *genie_events->at( v );
+
+        // All right, the event record is fully ready. Now ask the GReWeight
+        // objects to compute the weights. Some calculators temporarily modify
+        // the event record while computing a weight, so they are always given
+        // a private copy of the shared one.
+        std::vector<double>& nu_weights = weights[v];
+        genie::EventRecord event_copy( event );
+        for ( size_t u = first; u < last; ++u ) {
+          nu_weights[u] = fReweighters[ u - first ]->CalcWeight( event_copy );
+        }
       }
     }
     return weights;
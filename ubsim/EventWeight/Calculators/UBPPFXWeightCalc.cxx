@@ -9,9 +9,30 @@
 #include "dk2nu/tree/dkmeta.h"
 #include "nugen/EventGeneratorBase/GENIE/MCTruthAndFriendsItr.h"
 #include "cetlib/search_path.h"
+#include "cetlib_except/exception.h"
 
 #include "TSystem.h"
 
+#include <algorithm>
+
+namespace {
+  // PPFX weight categories whose product is the total hadron production
+  // weight of a universe; the order fixes the order of the product
+  const std::vector<std::string> kPPFXCategories = {
+    "MIPPNumiPionYields",
+    "MIPPNumiKaonYields",
+    "TargetAttenuation",
+    "TotalAbsorption",
+    "ThinTargetpCPion",
+    "ThinTargetpCKaon",
+    "ThinTargetpCNucleon",
+    "ThinTargetnCPion",
+    "ThinTargetnucleonA",
+    "ThinTargetMesonIncident",
+    "Other"
+  };
+}
+
 namespace evwgh {
   class UBPPFXWeightCalc : public WeightCalc
   {
@@ -32,6 +53,13 @@ namespace evwgh {
        int fVerbose;
        NeutrinoFluxReweight::MakeReweight* fPPFXrw;
 
+       // Beam metadata handed to PPFX, filled once in Configure
+       bsim::DkMeta fDkMeta;
+
+       // Per-event scratch matrix of category weights, [category][universe],
+       // kept between events so it is only allocated once
+       std::vector<double> fCategoryWeights;
+
      DECLARE_WEIGHTCALC(UBPPFXWeightCalc)
   };
   
@@ -74,6 +102,14 @@ namespace evwgh {
       fPPFXrw->SetOptions(inputOptions);	
     }
     std::cout << "PPFX just set with mode: " << fPPFXMode << std::endl;
+
+    // Replacement for the "construct_toy_dkmeta". The metadata only depends
+    // on the configuration, so build it once rather than refilling it (and
+    // growing vintnames) for every neutrino
+    fDkMeta.tgtcfg  = fTarget;
+    fDkMeta.horncfg = fHorn;
+    fDkMeta.vintnames.push_back("Index_Tar_In_Ancestry");
+    fDkMeta.vintnames.push_back("Playlist");
   }
 
   std::vector<std::vector<double> > UBPPFXWeightCalc::GetWeight(art::Event & e)
@@ -85,11 +121,6 @@ namespace evwgh {
     int nmctruth=0, nmatched=0;
     bool flag = true;
     int  ievt = -1;
-    std::vector<art::Handle<std::vector<bsim::Dk2Nu>>> dk2nus2;
-    e.getMany<std::vector<bsim::Dk2Nu>>();	
-    for (size_t dk2=0; dk2 < dk2nus2.size(); ++dk2) {
-      art::Handle<std::vector<bsim::Dk2Nu>> dk2nus = dk2nus2[dk2];
-    }
     while ( ( flag = mcitr.Next() ) ) {
       std::string label                  = mcitr.GetLabel();
       const simb::MCTruth*     pmctruth  = mcitr.GetMCTruth();
@@ -109,19 +140,6 @@ namespace evwgh {
       if ( ! pdk2nu ) continue;
       ++nmatched;
 
-      //RWH//bsim::Dk2Nu*  tmp_dk2nu  = fTmpDK2NUConversorAlg.construct_toy_dk2nu( &mctruth,&mcflux);
-      //RWH//bsim::DkMeta* tmp_dkmeta = fTmpDK2NUConversorAlg.construct_toy_dkmeta(&mctruth,&mcflux);
-      //RWH// those appear to have been memory leaks
-      //RWH// herein begins the replacment for the "construct_toy_dkmeta"
-
-      static bsim::DkMeta dkmeta_obj;        //RWH// create this on stack (destroyed when out-of-scope)  ... or static
-      dkmeta_obj.tgtcfg  = fTarget;
-      dkmeta_obj.horncfg = fHorn; 
-      (dkmeta_obj.vintnames).push_back("Index_Tar_In_Ancestry");
-      (dkmeta_obj.vintnames).push_back("Playlist");
-      bsim::DkMeta* tmp_dkmeta = &dkmeta_obj;
-      //RWH// herein ends this block
-
       // sigh ....
       //RWH// this is the signature in NeutrinoFluxReweight::MakeReweight :
       //      //! create an interaction chain from the new dk2nu(dkmeta) format
@@ -130,37 +148,42 @@ namespace evwgh {
       //RWH// and the pointers we get out of the ART record are going to be const.
       bsim::Dk2Nu* tmp_dk2nu = const_cast<bsim::Dk2Nu*>(pdk2nu);  // remove const-ness
       try {
-	fPPFXrw->calculateWeights(tmp_dk2nu,tmp_dkmeta);
+	fPPFXrw->calculateWeights(tmp_dk2nu,&fDkMeta);
       } catch (...) {
 	std::cerr<<"Failed to calcualte weight"<<std::endl;
 	continue;	
       }
       //Get weights:
       if (fMode=="reweight") {
-	double ppfx_cv_wgt = fPPFXrw->GetCVWeight();
-	std::vector<double> wvec = {ppfx_cv_wgt};
-	weight.push_back(wvec);
-      } else {
-	std::vector<double> vmipppion    = fPPFXrw->GetWeights("MIPPNumiPionYields");
-	std::vector<double> vmippkaon    = fPPFXrw->GetWeights("MIPPNumiKaonYields");
-	std::vector<double> vtgtatt      = fPPFXrw->GetWeights("TargetAttenuation");        
-	std::vector<double> vabsorp      = fPPFXrw->GetWeights("TotalAbsorption");
-	std::vector<double> vttpcpion    = fPPFXrw->GetWeights("ThinTargetpCPion");
-	std::vector<double> vttpckaon    = fPPFXrw->GetWeights("ThinTargetpCKaon");
-	std::vector<double> vttpcnucleon = fPPFXrw->GetWeights("ThinTargetpCNucleon");
-	std::vector<double> vttncpion    = fPPFXrw->GetWeights("ThinTargetnCPion");
-	std::vector<double> vttnucleona  = fPPFXrw->GetWeights("ThinTargetnucleonA");
-	std::vector<double> vttmesoninc  = fPPFXrw->GetWeights("ThinTargetMesonIncident");
-	std::vector<double> vothers      = fPPFXrw->GetWeights("Other");  
-
-	std::vector<double> tmp_vhptot;
-	for(unsigned int iuniv=0;iuniv<vtgtatt.size();iuniv++){
-	  tmp_vhptot.push_back(float(vmipppion[iuniv]*vmippkaon[iuniv]*vtgtatt[iuniv]*vabsorp[iuniv]*vttpcpion[iuniv]*
-				     vttpckaon[iuniv]*vttpcnucleon[iuniv]*vttncpion[iuniv]*vttnucleona[iuniv]*
-				     vttmesoninc[iuniv]*vothers[iuniv]));
+	weight.push_back({fPPFXrw->GetCVWeight()});
+	continue;
+      }
+
+      // Gather all categories into one [category][universe] matrix, then
+      // take the product over categories for every universe in one pass
+      const size_t ncat = kPPFXCategories.size();
+      size_t nuniv = 0;
+      for (size_t icat = 0; icat < ncat; ++icat) {
+	const std::vector<double> wcat = fPPFXrw->GetWeights(kPPFXCategories[icat]);
+	if (icat == 0) {
+	  nuniv = wcat.size();
+	  fCategoryWeights.resize(ncat*nuniv);
 	}
-	weight.push_back(tmp_vhptot);
+	else if (wcat.size() != nuniv) {
+	  throw cet::exception(__FUNCTION__) << GetName() << "::PPFX category "
+	    << kPPFXCategories[icat] << " has " << wcat.size() << " universes, expected "
+	    << nuniv << std::endl;
+	}
+	std::copy(wcat.begin(), wcat.end(), fCategoryWeights.begin() + icat*nuniv);
+      }
+
+      std::vector<double> tmp_vhptot(nuniv);
+      for (size_t iuniv = 0; iuniv < nuniv; ++iuniv) {
+	double w = fCategoryWeights[iuniv];
+	for (size_t icat = 1; icat < ncat; ++icat) w *= fCategoryWeights[icat*nuniv + iuniv];
+	tmp_vhptot[iuniv] = float(w);
       }
+      weight.push_back(std::move(tmp_vhptot));
     }
     return weight;
   }
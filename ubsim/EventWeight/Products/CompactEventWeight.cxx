@@ -0,0 +1,102 @@
+#include "CompactEventWeight.h"
+
+#include "cetlib_except/exception.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+  // Code 0 is reserved for zero weights, so log(weight) = 0 sits in the
+  // middle of the remaining range
+  constexpr long kLog16Zero = 32768;
+  constexpr long kLog16Max = std::numeric_limits<unsigned short>::max();
+}
+
+namespace evwgh {
+
+  int CompactWeightTable::Find(const std::string& name) const
+  {
+    auto it = std::find(fNames.begin(), fNames.end(), name);
+    return it == fNames.end() ? -1 : int(it - fNames.begin());
+  }
+
+  unsigned CompactWeightTable::Add(const std::string& name)
+  {
+    int const index = Find(name);
+    if (index >= 0) return index;
+    fNames.push_back(name);
+    return fNames.size() - 1;
+  }
+
+  void CompactWeightTable::aggregate(const CompactWeightTable& other)
+  {
+    size_t const ncommon = std::min(fNames.size(), other.fNames.size());
+    if (fEncoding != other.fEncoding || fLogStep != other.fLogStep ||
+        !std::equal(fNames.begin(), fNames.begin() + ncommon, other.fNames.begin())) {
+      throw cet::exception("CompactWeightTable")
+        << "Run fragments have different compact event weight layouts\n";
+    }
+    if (other.fNames.size() > fNames.size()) fNames = other.fNames;
+  }
+
+  unsigned short EncodeLog16(double weight, double log_step)
+  {
+    // Infinite and NaN weights saturate at the largest code rather than
+    // falling through lround, which is undefined outside the range of long
+    if (std::isnan(weight) || std::isinf(weight)) return weight < 0. ? 0 : kLog16Max;
+    if (!(weight > 0.)) return 0;
+
+    // Round only once the code is known to be within the 16 bits
+    double const x = std::log(weight) / log_step;
+    if (!(x < double(kLog16Max - kLog16Zero))) return kLog16Max;
+    if (!(x > double(1 - kLog16Zero))) return 1;
+    return static_cast<unsigned short>(std::lround(x) + kLog16Zero);
+  }
+
+  double DecodeLog16(unsigned short code, double log_step)
+  {
+    if (code == 0) return 0.;
+    return std::exp((long(code) - kLog16Zero) * log_step);
+  }
+
+  std::map<std::string, std::vector<double>>
+  ExpandWeights(const CompactWeightTable& table,
+                const CompactEventWeights& weights,
+                size_t itruth)
+  {
+    if (itruth >= weights.fNTruths) {
+      throw cet::exception("CompactEventWeights")
+        << "MCTruth " << itruth << " requested but the event only has "
+        << weights.fNTruths << '\n';
+    }
+
+    size_t const nfunc = weights.fNFunctions;
+    if (nfunc > table.fNames.size() || weights.fSizes.size() != weights.fNTruths * nfunc) {
+      throw cet::exception("CompactEventWeights")
+        << "Event weights with " << nfunc << " functions do not match the run table with "
+        << table.fNames.size() << " functions\n";
+    }
+
+    // Rows are stored back to back, so skip over the earlier MCTruths
+    size_t first = 0;
+    for (size_t i = 0; i < itruth * nfunc; ++i) first += weights.fSizes[i];
+
+    std::map<std::string, std::vector<double>> result;
+    for (size_t ifunc = 0; ifunc < nfunc; ++ifunc) {
+      unsigned const n = weights.fSizes[itruth * nfunc + ifunc];
+
+      std::vector<double>& w = result[table.fNames[ifunc]];
+      w.resize(n);
+      if (table.fEncoding == kLog16Weights) {
+        for (unsigned j = 0; j < n; ++j) w[j] = DecodeLog16(weights.fLog16[first + j], table.fLogStep);
+      }
+      else {
+        std::copy(weights.fFloat.begin() + first, weights.fFloat.begin() + first + n, w.begin());
+      }
+      first += n;
+    }
+    return result;
+  }
+
+} // namespace evwgh
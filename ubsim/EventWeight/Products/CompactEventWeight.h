@@ -0,0 +1,85 @@
+/**
+ * \file CompactEventWeight.h
+ * \brief Compact storage for evwgh::MCEventWeight products
+ *
+ * The weight function names are stored once per run in a CompactWeightTable.
+ * Each event stores the weights of all of its MCTruths in one contiguous
+ * block of CompactEventWeights, one row per MCTruth, either as floats or as
+ * 16-bit quantized log-weights, together with the number of universes of
+ * every weight function in every row.
+ */
+
+#ifndef UBSIM_EVENTWEIGHT_PRODUCTS_COMPACTEVENTWEIGHT_H
+#define UBSIM_EVENTWEIGHT_PRODUCTS_COMPACTEVENTWEIGHT_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace evwgh {
+
+  /// Storage formats for CompactEventWeights
+  enum CompactWeightEncoding {
+    kFloatWeights = 0, ///< single precision weights
+    kLog16Weights = 1  ///< log(weight) quantized to 16 bits in steps of fLogStep
+  };
+
+  /**
+   * \struct CompactWeightTable
+   * \brief Run-level names and encoding of the CompactEventWeights
+   *
+   * Weight functions are numbered in the order they first appeared in the
+   * run; functions seen later are appended, so an event only refers to the
+   * first CompactEventWeights::fNFunctions names.
+   */
+  struct CompactWeightTable {
+    std::vector<std::string> fNames;  ///< Weight function names, as keys of MCEventWeight::fWeight
+    int fEncoding = kFloatWeights;    ///< CompactWeightEncoding of the event products
+    double fLogStep = 0.;             ///< Quantization step of log(weight) for kLog16Weights
+
+    /// Index of the named weight function, or -1 if it is not in the table
+    int Find(const std::string& name) const;
+
+    /// Index of the named weight function, appending it if it is new
+    unsigned Add(const std::string& name);
+
+    /// Run fragments must share the encoding, and the names of one must
+    /// start with the names of the other; the longer list is kept. Throws
+    /// if they do not match.
+    void aggregate(const CompactWeightTable& other);
+  };
+
+  /**
+   * \struct CompactEventWeights
+   * \brief Weights of all MCTruths in an event, named by CompactWeightTable
+   *
+   * Only the vector matching the table encoding is filled. fSizes records how
+   * many universes each weight function returned for each MCTruth, so the
+   * rows can differ in length from MCTruth to MCTruth and from event to
+   * event. The universes of each row follow each other in table order.
+   */
+  struct CompactEventWeights {
+    unsigned fNTruths = 0;               ///< Number of MCTruths (rows)
+    unsigned fNFunctions = 0;            ///< Table names in use when the event was written
+    std::vector<unsigned> fSizes;        ///< [truth][function] universe counts
+    std::vector<float> fFloat;           ///< all rows, back to back, for kFloatWeights
+    std::vector<unsigned short> fLog16;  ///< all rows, back to back, for kLog16Weights
+  };
+
+  /// Quantize a weight. Zero and negative weights (including -inf) map to
+  /// code 0; +inf, NaN and weights above the encodable range saturate at the
+  /// largest code, weights below it at code 1.
+  unsigned short EncodeLog16(double weight, double log_step);
+
+  /// Inverse of EncodeLog16, to within a relative precision of log_step/2
+  double DecodeLog16(unsigned short code, double log_step);
+
+  /// Rebuild the MCEventWeight::fWeight map of one MCTruth
+  std::map<std::string, std::vector<double>>
+  ExpandWeights(const CompactWeightTable& table,
+                const CompactEventWeights& weights,
+                size_t itruth);
+
+} // namespace evwgh
+
+#endif
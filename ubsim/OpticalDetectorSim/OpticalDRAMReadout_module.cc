@@ -48,6 +48,7 @@
 #include <map>
 #include <memory>
 #include <cmath>
+#include <algorithm>
 
 namespace opdet {
 
@@ -76,10 +77,22 @@ namespace opdet {
     /// Readout frame offset (w.r.t. trigger frame)
     std::vector<optdata::Frame_t> fReadoutFrameOffset;
 
+    /// Open a readout window for every raw::Trigger instead of the DetectorClocksService trigger time
+    bool fUseAllTriggers;
+
     /// Names of data products: one for each Optical Category
     std::map< opdet::UBOpticalChannelCategory_t, std::string > fPMTdataProductNames;
     void registerOpticalData();
-    void putPMTDigitsIntoEvent( std::map< opdet::UBOpticalChannelCategory_t, std::unique_ptr< std::vector<raw::OpDetWaveform> > >& pmtdigitlist, art::Event& event);
+    void putPMTDigitsIntoEvent( std::vector< std::unique_ptr< std::vector<raw::OpDetWaveform> > >& pmtdigitlist, art::Event& event);
+
+    /// Readout window [start,end) frames for a trigger frame
+    std::pair<optdata::Frame_t,optdata::Frame_t> ReadoutFrames(const optdata::Frame_t trig_frame) const;
+
+    /// FIFO (frame, index) pairs sorted by frame, rebuilt once per event
+    std::vector< std::pair<optdata::Frame_t,size_t> > fFrameIndex;
+
+    /// Indexes of FIFOs selected for readout (buffer reused across events)
+    std::vector<size_t> fSelected;
 
   };
 } // namespace opdet
@@ -123,11 +136,23 @@ namespace opdet {
 
   /// ------------------------------------------------------------------------------------
 
-  void OpticalDRAMReadout::putPMTDigitsIntoEvent( std::map< opdet::UBOpticalChannelCategory_t, 
-						  std::unique_ptr< std::vector<raw::OpDetWaveform> > >& pmtdigitlist, 
+  void OpticalDRAMReadout::putPMTDigitsIntoEvent( std::vector< std::unique_ptr< std::vector<raw::OpDetWaveform> > >& pmtdigitlist, 
 						  art::Event& event ) {
     for ( unsigned int cat=0; cat<(unsigned int)opdet::NumUBOpticalChannelCategories; cat++ )
-      event.put( std::move( pmtdigitlist[(opdet::UBOpticalChannelCategory_t)cat] ), fPMTdataProductNames[ (opdet::UBOpticalChannelCategory_t)cat ] );    
+      event.put( std::move( pmtdigitlist[cat] ), fPMTdataProductNames[ (opdet::UBOpticalChannelCategory_t)cat ] );    
+  }
+
+  /// ------------------------------------------------------------------------------------
+
+  std::pair<optdata::Frame_t,optdata::Frame_t> OpticalDRAMReadout::ReadoutFrames(const optdata::Frame_t trig_frame) const
+  {
+    optdata::Frame_t start_frame = 0;
+    optdata::Frame_t end_frame = trig_frame + fReadoutFrameOffset.at(1);
+
+    if(trig_frame < fReadoutFrameOffset.at(0)) start_frame = 0;
+    else start_frame = trig_frame - fReadoutFrameOffset.at(0);
+
+    return std::make_pair(start_frame,end_frame);
   }
 
   /// ------------------------------------------------------------------------------------
@@ -143,6 +168,8 @@ namespace opdet {
 
     fDataProductsStemName = p.get<std::string>( "OpDataProductStemName", "opdrammcreadout");
 
+    fUseAllTriggers     = p.get<bool>("UseAllTriggers", false);
+
     // do we want to give user option to name data?
     // do this here
 
@@ -172,11 +199,10 @@ namespace opdet {
 
     // -----------------------------------
     // Create out container of waveforms: one container per readout channel type
-    std::map< opdet::UBOpticalChannelCategory_t, std::unique_ptr< std::vector<raw::OpDetWaveform> > > pmt_raw_digits;
-    for ( unsigned int opdetcat=0; opdetcat<(unsigned int)opdet::NumUBOpticalChannelCategories; opdetcat++ ) {
-      pmt_raw_digits.insert( std::make_pair( (opdet::UBOpticalChannelCategory_t)opdetcat, std::unique_ptr< std::vector<raw::OpDetWaveform> >(  new std::vector<raw::OpDetWaveform> ) ) );
-    }
-    //std::unique_ptr< std::vector<optdata::OpticalRawDigit> > wf_array( new std::vector<optdata::OpticalRawDigit> ); // deprecated
+    std::vector< std::unique_ptr< std::vector<raw::OpDetWaveform> > > pmt_raw_digits;
+    pmt_raw_digits.reserve( opdet::NumUBOpticalChannelCategories );
+    for ( unsigned int opdetcat=0; opdetcat<(unsigned int)opdet::NumUBOpticalChannelCategories; opdetcat++ )
+      pmt_raw_digits.emplace_back( new std::vector<raw::OpDetWaveform> );
 
     // -----------------------------------
     // PMT Trigger Sim
@@ -197,41 +223,28 @@ namespace opdet {
     // Figure out the range of frame numbers to be readout
     std::vector<std::pair<optdata::Frame_t,optdata::Frame_t> > readout_frames;
 
-    optdata::Frame_t trig_frame = clock.Frame(clockData.TriggerTime());
-    
-    optdata::Frame_t start_frame = 0;
-    optdata::Frame_t end_frame = trig_frame + fReadoutFrameOffset.at(1);
-
-    if(trig_frame < fReadoutFrameOffset.at(0)) start_frame = 0;
-    else start_frame = trig_frame - fReadoutFrameOffset.at(0);
-
-    readout_frames.push_back(std::make_pair(start_frame,end_frame));
-
-    /*
-    //
-    // In case of multipl trigger data products ... commented out for now
-    //
-    if(!trig_array.isValid())
-
-      throw UBOpticalException(Form("Did not find raw::Trigger data product from module %s",fTrigModuleName.c_str()));
-
-    readout_frames.reserve(trig_array->size());
-    for(size_t i=0; i<trig_array->size(); ++i) {
-
-      const art::Ptr<raw::Trigger> trig_ptr(trig_array,i);
-
-      optdata::Frame_t trig_frame = clock.Frame(trig_ptr->TriggerTime());
-
-      optdata::Frame_t start_frame = 0;
-      optdata::Frame_t end_frame = trig_frame + fReadoutFrameOffset.at(1);
-
-      if(trig_frame < fReadoutFrameOffset.at(0)) start_frame = 0;
-      else start_frame = trig_frame - fReadoutFrameOffset.at(0);
-
-      readout_frames.push_back(std::pair<optdata::Frame_t,optdata::Frame_t>(start_frame,end_frame) );
+    if(fUseAllTriggers && trig_array.isValid() && !trig_array->empty()) {
+      //
+      // In case of multiple triggers: one readout window per trigger
+      //
+      readout_frames.reserve(trig_array->size());
+      for(auto const& trig : *trig_array)
+	readout_frames.push_back(ReadoutFrames(clock.Frame(trig.TriggerTime())));
     }
-    */   
-    
+    else
+      readout_frames.push_back(ReadoutFrames(clock.Frame(clockData.TriggerTime())));
+
+    // Merge overlapping windows so that each FIFO is selected at most once
+    std::sort(readout_frames.begin(),readout_frames.end());
+    size_t nwindows = 0;
+    for(auto const& period : readout_frames) {
+      if(nwindows && period.first <= readout_frames[nwindows-1].second)
+	readout_frames[nwindows-1].second = std::max(readout_frames[nwindows-1].second,period.second);
+      else
+	readout_frames[nwindows++] = period;
+    }
+    readout_frames.resize(nwindows);
+
     // -----------------------------------    
     // Read in optdata::FIFOChannel & store relevant portion
 
@@ -243,47 +256,45 @@ namespace opdet {
     }
     else {
 
-      // we want to reserve enough space, once. trading speed at the cost of wasting memory
+      // Frame index: select FIFOs inside each readout window by binary search
+      fFrameIndex.clear();
+      fFrameIndex.reserve(fifo_array->size());
+      for(size_t i=0; i<fifo_array->size(); ++i)
+	fFrameIndex.emplace_back((*fifo_array)[i].Frame(),i);
+      std::sort(fFrameIndex.begin(),fFrameIndex.end());
+
+      fSelected.clear();
+      for(auto const &period : readout_frames) {
+	auto first = std::lower_bound(fFrameIndex.begin(),fFrameIndex.end(),
+				      std::make_pair(period.first,(size_t)0));
+	auto last  = std::lower_bound(first,fFrameIndex.end(),
+				      std::make_pair(period.second,(size_t)0));
+	for(auto it=first; it!=last; ++it)
+	  fSelected.push_back((*it).second);
+      }
+
+      // Keep the input FIFO order in the output
+      std::sort(fSelected.begin(),fSelected.end());
+
       for ( auto &it : pmt_raw_digits )
-	it.second->reserve( fifo_array->size() );
-
-
-      for(size_t i=0; i<fifo_array->size(); ++i) {
-
-	const art::Ptr<optdata::FIFOChannel> fifo_ptr(fifo_array,i);
-	
-	bool store=false;
-	for(auto const &period : readout_frames)
-	  
-	  if( period.first <= fifo_ptr->Frame() && fifo_ptr->Frame() < period.second ) {
-	    
-	    store=true;
-	    break;
-	    
-	  }
-	
-	if(store){
-
-	  // if FIFO has correct categories, then fine.
-	  // but for now, get it using the channel number
-	  unsigned int data_product_ch_num = fifo_ptr->ChannelNumber();
-	  opdet::UBOpticalChannelCategory_t category = ub_pmt_channel_map->GetChannelCategory( data_product_ch_num );
-	  auto it_wfarray = pmt_raw_digits.find( category );
-	  double window_timestamp = clock.Time( fifo_ptr->TimeSlice(), fifo_ptr->Frame() );
-
-	  raw::OpDetWaveform rd( window_timestamp, data_product_ch_num, fifo_ptr->size() );
-	  for ( size_t iadc=0; iadc< fifo_ptr->size(); iadc++ )
-	    rd.push_back( fifo_ptr->at(iadc) );
-	  (*it_wfarray).second->emplace_back( rd );
-	  // std::cout << "DRAM: Store FIFO from CH=" << data_product_ch_num 
-	  // 	    << " put into " << opdet::UBOpChannelEnumName( (opdet::UBOpticalChannelCategory_t)category ) 
-	  // 	    << " timestamp=" << window_timestamp 
-	  // 	    << " frame=" << fifo_ptr->Frame()
-	  // 	    << " timeslice/sample=" << fifo_ptr->TimeSlice()
-	  // 	    << " size=" << fifo_ptr->size()
-	  // 	    << std::endl;
-	}// if store
-      }// loop over FIFO data
+	it->reserve( fSelected.size() );
+
+      for(auto const& i : fSelected) {
+
+	auto const& fifo = (*fifo_array)[i];
+
+	// if FIFO has correct categories, then fine.
+	// but for now, get it using the channel number
+	unsigned int data_product_ch_num = fifo.ChannelNumber();
+	opdet::UBOpticalChannelCategory_t category = ub_pmt_channel_map->GetChannelCategory( data_product_ch_num );
+	double window_timestamp = clock.Time( fifo.TimeSlice(), fifo.Frame() );
+
+	// FIFO samples are owned by the input product (and differ in type), so one bulk copy
+	// into the waveform which is then moved into the output
+	raw::OpDetWaveform rd( window_timestamp, data_product_ch_num, fifo.size() );
+	rd.assign( fifo.begin(), fifo.end() );
+	pmt_raw_digits[category]->emplace_back( std::move(rd) );
+      }// loop over selected FIFO data
 
     }// if valid
 
@@ -0,0 +1,55 @@
+#ifndef SPERESPONSEREGISTRY_CXX
+#define SPERESPONSEREGISTRY_CXX
+
+#include "SPEResponseRegistry.h"
+#include "WFAlgoUtilities.h"
+#include "UBOpticalException.h"
+#include "TString.h"
+
+namespace opdet {
+
+  //----------------------------------------------------------------------------------------
+  std::shared_ptr<const SPEResponse> SPEResponseRegistry::Get(const std::string& name)
+  //----------------------------------------------------------------------------------------
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto iter = _responses.find(name);
+    if(iter != _responses.end()) return (*iter).second;
+
+    auto res = Build(name);
+    _responses.emplace(name,res);
+    return res;
+  }
+
+  //----------------------------------------------------------------------------------------
+  std::shared_ptr<const SPEResponse> SPEResponseRegistry::Build(const std::string& name) const
+  //----------------------------------------------------------------------------------------
+  {
+    std::vector<float> wf;
+    if(name == "Normal_BNLv1")      SetResponseNormal_BNLv1(wf);
+    else if(name == "OpCh28_BNLv1") SetResponseOpCh28_BNLv1(wf);
+    else
+      throw UBOpticalException(Form("Unknown SPE response name: %s",name.c_str()));
+
+    detinfo::ElecClock const time{0., 1600., 1000.}; // 1.6ms frame period, 1GHz frequency
+    if(time.Ticks() >= static_cast<int>(wf.size()))
+      throw UBOpticalException(Form("Invalid WF index (%d) for the WF of size %zu",
+				    time.Ticks(),
+				    wf.size()
+				    )
+			       );
+
+    // Trailing zeros never contribute to a waveform
+    while(wf.size() > (size_t)(time.Ticks()+1) && wf.back() == 0.) wf.pop_back();
+    wf.shrink_to_fit();
+
+    std::vector<double> cumulative(wf.size()+1, 0.);
+    for(size_t i=0; i<wf.size(); ++i) cumulative[i+1] = cumulative[i] + wf[i];
+
+    return std::make_shared<const SPEResponse>(SPEResponse{name, std::move(wf), std::move(cumulative), time});
+  }
+
+}
+
+#endif
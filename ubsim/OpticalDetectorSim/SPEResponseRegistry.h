@@ -0,0 +1,87 @@
+/**
+ * \file SPEResponseRegistry.h
+ *
+ * \ingroup OpticalDetectorSim
+ * 
+ * \brief Class def header for a class SPEResponseRegistry
+ *
+ * @author kazuhiro
+ */
+
+/** \addtogroup OpticalDetectorSim
+
+    @{*/
+#ifndef SPERESPONSEREGISTRY_H
+#define SPERESPONSEREGISTRY_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "lardataalg/DetectorInfo/ElecClock.h"
+
+namespace opdet {
+
+  /**
+     \struct SPEResponse
+     Immutable digitized SPE response: the sampled waveform (trailing zeros removed),
+     its timing information and cumulative sums used to integrate the response over
+     arbitrary (e.g. optical clock tick) time bins.
+  */
+  struct SPEResponse {
+
+    /// Response name (registry key)
+    std::string name;
+
+    /// Sampled SPE waveform
+    std::vector<float> wf;
+
+    /// cumulative[i] = sum of wf[0..i-1] (size wf.size()+1)
+    std::vector<double> cumulative;
+
+    /// Sampling period & signal timing of wf
+    detinfo::ElecClock time;
+
+  };
+
+  /**
+     \class SPEResponseRegistry
+     Process-wide store of digitized SPE responses, built once on first request and
+     shared by every SPE algorithm instance.
+  */
+  class SPEResponseRegistry {
+
+  private:
+
+    /// Default constructor
+    SPEResponseRegistry(){};
+
+    /// Default destructor
+    virtual ~SPEResponseRegistry(){};
+
+  public:
+
+    static SPEResponseRegistry& GetME()
+    {
+      static SPEResponseRegistry me;
+      return me;
+    }
+
+    /// Getter for a response by name ("Normal_BNLv1" or "OpCh28_BNLv1"); throws for unknown names
+    std::shared_ptr<const SPEResponse> Get(const std::string& name);
+
+  private:
+
+    /// Builds a response from the hard-coded tables in WFAlgoUtilities
+    std::shared_ptr<const SPEResponse> Build(const std::string& name) const;
+
+    std::mutex _mutex;
+
+    std::map<std::string, std::shared_ptr<const SPEResponse> > _responses;
+
+  };
+}
+
+#endif
+/** @} */ // end of doxygen group 
@@ -5,12 +5,16 @@
 
 #include "larcore/Geometry/WireReadout.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace opdet {
 
   //----------------------------------------
   UBOpticalADC::UBOpticalADC() : UBADCBase()
   //----------------------------------------
   {
+    fApplyQE = true;
     Reset();
   }
 
@@ -58,25 +62,60 @@ namespace opdet {
     */
   }
 
+  //------------------------------
+  void UBOpticalADC::SetDarkRates()
+  //------------------------------
+  {
+    art::ServiceHandle<geo::Geometry> geom;
+    art::ServiceHandle<opdet::UBOpticalChConfig> ch_conf;
+    auto const& channelMapAlg = art::ServiceHandle<geo::WireReadout const>()->Get();
+
+    fDarkRate.clear();
+    fDarkRate.reserve(geom->NOpDets());
+
+    for(unsigned int pmtid=0; pmtid<geom->NOpDets(); ++pmtid) {
+
+      unsigned int ch = channelMapAlg.OpChannel( pmtid, 0 ); // get channel reading out that PMT
+
+      // kDarkRate x fDuration is the mean count while pulses span fDuration*1.e3 in G4 time
+      fDarkRate.push_back(ch_conf->GetFloat(kDarkRate,ch) * 1.e-3);
+    }
+  }
+
   //--------------------------------------------------------------------------
-  //void UBOpticalADC::GenDarkNoise(double dark_rate, double period)
   void UBOpticalADC::GenDarkNoise(const unsigned int pmtid, const double g4start)
   //--------------------------------------------------------------------------
   {
     fDarkPhotonTime.clear();
 
-    art::ServiceHandle<opdet::UBOpticalChConfig> ch_conf;
-    unsigned int ch = art::ServiceHandle<geo::WireReadout const>()->Get().OpChannel( pmtid, 0 ); // get channel reading out that PMT
+    if(fDarkRate.empty()) SetDarkRates();
 
-    double dark_rate = ch_conf->GetFloat(kDarkRate,ch);
+    if(pmtid >= fDarkRate.size())
+      throw UBOpticalException(Form("No dark rate tabulated for PMT %u",pmtid));
 
-    unsigned int dark_count = RandomServer::GetME().Poisson(dark_rate * fDuration);
+    const double rate = fDarkRate[pmtid];
 
-    fDarkPhotonTime.reserve(dark_count);
+    if(rate <= 0) return;
 
-    for(size_t i=0; i<dark_count; ++i)
+    // Poisson process over the waveform: exponential inter-arrival times give
+    // pulse times that are already sorted. Uniforms are drawn in batches of
+    // roughly the expected count (TRandom3 never returns 0, so log is safe).
+    const double window = fDuration * 1.e3;
+    const double mean_count = rate * window;
+    const size_t batch = std::max((size_t)16, (size_t)(mean_count + 3 * std::sqrt(mean_count)));
 
-      fDarkPhotonTime.push_back(RandomServer::GetME().Uniform(fDuration*1.e3) + g4start);
+    fDarkPhotonTime.reserve(batch);
+
+    double t = 0;
+    while(1) {
+      fUniformBuffer.resize(batch);
+      RandomServer::GetME().RndmArray(batch,fUniformBuffer.data());
+      for(auto const& u : fUniformBuffer) {
+	t -= std::log(u) / rate;
+	if(t >= window) return;
+	fDarkPhotonTime.push_back(t + g4start);
+      }
+    }
 
   }
 
@@ -122,9 +161,17 @@ namespace opdet {
     fPhotonTime.reserve(fInputPhotonTime.size() + fDarkPhotonTime.size());
     const double qe = ch_conf->GetFloat(kQE,ch);
 
-    for(auto const &v : fDarkPhotonTime) fPhotonTime.push_back(v);
-    for(auto const &v : fInputPhotonTime)
-      if(RandomServer::GetME().Uniform(1.) < qe) fPhotonTime.push_back(v);
+    if(!fApplyQE)
+      fPhotonTime.insert(fPhotonTime.end(),fInputPhotonTime.begin(),fInputPhotonTime.end());
+    else {
+      for(auto const &v : fInputPhotonTime)
+	if(RandomServer::GetME().Uniform(1.) < qe) fPhotonTime.push_back(v);
+    }
+    // Dark noise is generated time-ordered: sort signal and merge to keep photons sorted
+    const size_t nsignal = fPhotonTime.size();
+    std::sort(fPhotonTime.begin(),fPhotonTime.end());
+    fPhotonTime.insert(fPhotonTime.end(),fDarkPhotonTime.begin(),fDarkPhotonTime.end());
+    std::inplace_merge(fPhotonTime.begin(),fPhotonTime.begin()+nsignal,fPhotonTime.end());
     fSPE.SetOpChannel(ch);
     fSPE.SetPhotons(fPhotonTime);
     fSPE.Process(wfm_tmp,clockData,fTimeInfo);
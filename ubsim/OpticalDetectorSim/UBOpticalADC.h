@@ -39,6 +39,9 @@ namespace opdet {
     /// Function to enable gain/T0 spread
     void EnableSpread(bool doit=true) { fSPE.EnableSpread(doit); }
 
+    /// Function to enable per-channel QE thinning in GenWaveform (disable if photons are pre-thinned)
+    void EnableQE(bool doit=true) { fApplyQE = doit; }
+
     /// Function to add G4 photon in G4 time (ns as that is G4 natural unit)
     void AddPhoton(double g4time){ fInputPhotonTime.push_back(g4time); }
 
@@ -55,7 +58,10 @@ namespace opdet {
     /// Method to retrieve dark-noise photon time vector
     const std::vector<double>& DarkPhotonTime() const { return fDarkPhotonTime; }
     
-    /// Function to generate dark noise photon timings (called in GenWaveform)
+    /// Function to tabulate per-PMT dark rates from UBOpticalChConfig (call once at configuration)
+    void SetDarkRates();
+
+    /// Function to generate time-ordered dark noise photon timings (called in GenWaveform)
     void GenDarkNoise(const unsigned int pmtid, const double g4start);
 
     /// Function to set abnormal SPE response opch
@@ -72,6 +78,15 @@ namespace opdet {
     /// Photon time that is injected to the waveform (after QE applied)
     std::vector<double> fPhotonTime;
 
+    /// Boolean to apply QE on signal photons in GenWaveform
+    bool fApplyQE;
+
+    /// Dark rate per PMT in 1/ns (G4 time unit), tabulated by SetDarkRates
+    std::vector<double> fDarkRate;
+
+    /// Buffer of uniform random numbers reused by GenDarkNoise
+    std::vector<double> fUniformBuffer;
+
     /// Algorithm to generate SPE waveform
     //WFAlgoAnalyticalSPE fSPE;
     WFAlgoDigitizedSPE fSPE;
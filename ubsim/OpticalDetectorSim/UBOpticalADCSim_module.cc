@@ -44,6 +44,8 @@
 #include "UBOpticalADC.h" // uboonecode
 #include "UBLogicPulseADC.h" // uboonecode
 #include "ubcore/Geometry/UBOpReadoutMap.h" // uboone
+#include "ubevt/Database/LightYieldService.h" // ubevt
+#include "ubevt/Database/LightYieldProvider.h" // ubevt
 
 /// nutools
 #include "lardataobj/Simulation/BeamGateInfo.h"
@@ -94,6 +96,12 @@ namespace opdet {
 
     /// OpCh with abnormal SPE response
     int fAbnormCh;
+
+    /// Apply LY scaling x QE as a single acceptance per PMT while collecting photons
+    bool fFusedAcceptance;
+
+    /// Include LightYieldProvider scaling in the fused acceptance
+    bool fApplyLYScaling;
   };
 
 } 
@@ -135,6 +143,18 @@ namespace opdet {
     fAbnormCh = pset.get<int>("AbnormalOpCh",28);
     fOpticalGen.SetAbnormalCh(fAbnormCh);
 
+    fFusedAcceptance = pset.get<bool>("FusedAcceptance",false);
+
+    fApplyLYScaling = pset.get<bool>("ApplyLYScaling",false);
+
+    if(fApplyLYScaling && !fFusedAcceptance)
+      throw UBOpticalException("ApplyLYScaling requires FusedAcceptance to be enabled!");
+
+    // QE is folded into the per-PMT acceptance when fused
+    fOpticalGen.EnableQE(!fFusedAcceptance);
+
+    fOpticalGen.SetDarkRates();
+
     produces< optdata::ChannelDataGroup >();
 
     produces< std::vector<sim::BeamGateInfo > >();
@@ -204,6 +224,12 @@ namespace opdet {
       pmt_indexes.at(pmt->OpChannel()).push_back(i);
     }
 
+    // Light yield scaling is only needed by the fused acceptance stage
+    const lariov::LightYieldProvider* ly_provider = nullptr;
+    if(fApplyLYScaling)
+      ly_provider = &(art::ServiceHandle<lariov::LightYieldService>()->GetProvider());
+    art::ServiceHandle<opdet::UBOpticalChConfig> ch_conf;
+
     // ================================================================================================================================
     //
     // Loop over opdets, and make waveforms for each readout channels. process photons, make, then store waveforms
@@ -213,14 +239,29 @@ namespace opdet {
       // transfer the time of each hit (in opdet 'ch') into a vector<double>
       std::vector<double> photon_time;
 
+      // Combined LY scaling x QE acceptance for this PMT. QE is taken from the first
+      // readout channel, so all gain streams of a PMT share the same photoelectrons.
+      double acceptance = 1.;
+      if(fFusedAcceptance) {
+	acceptance = ch_conf->GetFloat(kQE,channelMapAlg.OpChannel(ipmt,0));
+	if(ly_provider) acceptance *= ly_provider->LYScaling(ipmt);
+      }
+
       for(auto const &pmt_index : pmt_indexes.at(ipmt)) {
 	
 	const art::Ptr<sim::SimPhotons> pmt_ptr(pmtHandle,pmt_index);
 	
-	photon_time.reserve(photon_time.size() + pmt_ptr->size());
-	
-	for(size_t photon_index=0; photon_index<pmt_ptr->size(); ++photon_index)
-	  photon_time.push_back(pmt_ptr->at(photon_index).Time);
+	if(!fFusedAcceptance) {
+	  photon_time.reserve(photon_time.size() + pmt_ptr->size());
+	  for(size_t photon_index=0; photon_index<pmt_ptr->size(); ++photon_index)
+	    photon_time.push_back(pmt_ptr->at(photon_index).Time);
+	  continue;
+	}
+
+	// Binomial thinning: accepted photons are the only ones ever copied
+	photon_time.reserve(photon_time.size() + (size_t)(pmt_ptr->size() * acceptance) + 1);
+	for(auto const& photon : *pmt_ptr)
+	  if(RandomServer::GetME().Uniform(1.) < acceptance) photon_time.push_back(photon.Time);
       }
       //std::cout<<"INPUT: pmt="<<ipmt<<" PE ="<<photon_time.size()<<std::endl;
       // send the hits over to the waveform generator
@@ -267,7 +308,6 @@ namespace opdet {
     // Handle special readout channels (>= 40)
     //
     art::ServiceHandle<geo::UBOpReadoutMap> chanmap;
-    art::ServiceHandle<opdet::UBOpticalChConfig> ch_conf;
     std::vector< unsigned int > logicchannels;
     chanmap->GetLogicChannelList( logicchannels );
     
@@ -2,47 +2,18 @@
 #define WFALGODIGITIZEDSPE_CXX
 
 #include "WFAlgoDigitizedSPE.h"
-#include "WFAlgoUtilities.h"
 #include "larcore/CoreUtils/ServiceUtil.h"
 #include "lardata/DetectorInfoServices/DetectorClocksService.h"
 
-namespace {
-  auto normal_response()
-  {
-    std::vector<float> wf;
-    opdet::SetResponseNormal_BNLv1(wf);
-    return wf;
-  }
-    
-  auto opch28_response()
-  {
-    std::vector<float> wf;
-    opdet::SetResponseOpCh28_BNLv1(wf);
-    return wf;
-  }
-    
-  auto default_clock(const std::vector<float> &wf)
-  {
-    detinfo::ElecClock const result{0., 1600., 1000.}; // 1.6ms frame period, 1GHz frequency
-    if(result.Ticks() >= static_cast<int>(wf.size()))
-      throw opdet::UBOpticalException(Form("Invalid WF index (%d) for the WF of size %zu",
-                                           result.Ticks(),
-                                           wf.size()
-                                           )
-                                      );
-    return result;
-  }
-}
-
+#include <algorithm>
+#include <cmath>
 
 namespace opdet {
 
   //--------------------------------------------------------
   WFAlgoDigitizedSPE::WFAlgoDigitizedSPE()
-    : fSPE_Normal{normal_response()}
-    , fSPE_Abnormal{opch28_response()}
-    , fSPETime_Normal{default_clock(fSPE_Normal)}
-    , fSPETime_Abnormal{default_clock(fSPE_Abnormal)}
+    : fResponse_Normal{SPEResponseRegistry::GetME().Get("Normal_BNLv1")}
+    , fResponse_Abnormal{SPEResponseRegistry::GetME().Get("OpCh28_BNLv1")}
   {}
 
   //------------------------------
@@ -53,92 +24,104 @@ namespace opdet {
   }
 
   //--------------------------------------------------------------
-  void WFAlgoDigitizedSPE::Process(std::vector<float> &wf,
-                                   const detinfo::DetectorClocksData& clockData,
-				   const ::detinfo::ElecClock &start_time)
+  void WFAlgoDigitizedSPE::SelectPhotons(const detinfo::DetectorClocksData& clockData,
+					 const ::detinfo::ElecClock &start_time,
+					 const ::detinfo::ElecClock &spe_time,
+					 const size_t nticks)
   //--------------------------------------------------------------
   {
-    // Predefine variables to save time later
-    ::detinfo::ElecClock rel_spe_start = start_time.WithTime(0);
+    fSPEStartTime.clear();
+    fSPEStartTime.reserve(fPhotonTime.size());
 
-    auto const& fSPETime = GetClock(OpChannel());
-    auto const& fSPE = GetSPE(OpChannel());
+    // Waveform window in electronics clock frame
+    const double window_start = start_time.Time();
+    const double window_end   = start_time.Time() + start_time.Time((int)nticks);
 
-    double unit_time = fSPETime.TickPeriod();
+    // SPE start time offset w.r.t. waveform start
+    const double spe_offset = spe_time.Time() + window_start;
 
     for(auto const &t : fPhotonTime) {
 
-      //
-      // Check if this photon should be added or not
-      //
-
       // Time in electronics clock frame (with T0)
-      //double time = ::detinfo::DetectorClocksService::GetME().G4ToElecTime(t);
       double time = clockData.G4ToElecTime(t);
 
       if(fEnableSpread)  time +=  RandomServer::GetME().Gaus(fT0,fT0Sigma) * 1.e-3 ;
       else time += fT0 * 1.e-3;
 
-      // If before waveform vector, ignore
-      if(time < start_time.Time()) continue;
+      // If outside waveform vector, ignore
+      if(time < window_start || time > window_end) continue;
 
-      // If after waveform vector, ignore
-      if(time > (start_time.Time() + start_time.Time((int)(wf.size())))) continue;
+      fSPEStartTime.push_back(time - spe_offset);
+    }
 
-      //
-      // Add signal
-      //
+    // Time-ordered photons keep consecutive SPE additions on neighbouring ticks.
+    // Sorted input stays sorted unless T0 spread shuffled it.
+    if(!std::is_sorted(fSPEStartTime.begin(),fSPEStartTime.end()))
+      std::sort(fSPEStartTime.begin(),fSPEStartTime.end());
+  }
 
-      // Figure out time stamp of the beginning of SPE
-      rel_spe_start = rel_spe_start.WithTime(time - fSPETime.Time() - start_time.Time());
-      //float maxval = 0;
-      //int   argmax = 0;
-      //int start = rel_spe_start.Ticks();
-      //std::cout<<fSPE[51]<<std::endl;
+  //--------------------------------------------------------------
+  void WFAlgoDigitizedSPE::Process(std::vector<float> &wf,
+                                   const detinfo::DetectorClocksData& clockData,
+				   const ::detinfo::ElecClock &start_time)
+  //--------------------------------------------------------------
+  {
+    auto const& response = GetResponse(OpChannel());
+    auto const& fSPETime = response.time;
+    auto const& fSPE = response.wf;
+    auto const& cumulative = response.cumulative;
 
-      auto thisgain = RandomServer::GetME().Gaus(fGain,fGainSigma*fGain);
+    SelectPhotons(clockData,start_time,fSPETime,wf.size());
 
-      for(size_t i=0; i < fSPE.size(); ++i ) {
+    // Predefine variables to save time later
+    const double unit_time   = fSPETime.TickPeriod();
+    const double tick_period = start_time.TickPeriod();
+    const int    nticks      = wf.size();
+
+    // SPE tail truncation: stop after the first small (< 1 ADC) sample beyond 300
+    size_t nsamples = fSPE.size();
+    for(size_t i=0; i < fSPE.size(); ++i ) {
+      if( (unit_time * i) > 300 && fabs(fGain * fSPE[i]) < 1) {
+	nsamples = i+1;
+	break;
+      }
+    }
 
-	if(rel_spe_start.Ticks() >= (int)(wf.size())) break;
+    // SPE sample i sits at spe_start + i * unit_time and is added to tick (int)(time/tick_period),
+    // so tick 0 collects (-tick_period,tick_period). Instead of adding samples one by one,
+    // the response is integrated over each tick from its cumulative sum.
+    auto tick_of = [&](const double spe_start, const size_t i)
+      { return (int)((spe_start + i * unit_time) / tick_period); };
 
-	if(rel_spe_start.Ticks() >= 0) {
+    for(auto const &spe_start : fSPEStartTime) {
 
-	  float val = 0.;
+      auto thisgain = RandomServer::GetME().Gaus(fGain,fGainSigma*fGain);
+      const double gain = (fEnableSpread ? thisgain : fGain);
 
-	  if(!fEnableSpread) 
+      // First sample inside the waveform
+      size_t i = 0;
+      if(spe_start <= -tick_period) {
+	i = (size_t)((-tick_period - spe_start) / unit_time);
+	while(i < nsamples && (spe_start + i * unit_time) <= -tick_period) ++i;
+      }
 
-	    val = (fGain * fSPE.at(i));
+      while(i < nsamples) {
 
-	  else
+	const int tick = tick_of(spe_start,i);
 
-	    val = (  thisgain * fSPE.at(i) );
-	    
-	  wf.at(rel_spe_start.Ticks()) += val;
-	  /*
-	  if(val > maxval) {
-	    maxval = val;
-	    argmax = rel_spe_start.Ticks() - start;
-	  }
-	  */
-	}
+	if(tick >= nticks) break;
 
-        rel_spe_start = rel_spe_start.AdvanceTimeBy(unit_time);
-	if( (unit_time * i) > 300 && fabs(fGain * fSPE.at(i)) < 1)
-	  break;
-      }
-      /*
-      std::cout << "OpCh: " << OpChannel() << std::endl;
-      std::cout << "  Max Value: " << maxval << " (gain) " << fGain << " added @ " << argmax << " (local vector)" << std::endl;
-      maxval = 0;
-      argmax = 0;
-      for(int i=start; i<(start+20); ++i) {
-	if(wf[i] <= maxval) continue;
-	maxval = wf[i];
-	argmax = i;
+	// First sample of the next tick
+	size_t j = (size_t)(std::ceil(((tick+1) * tick_period - spe_start) / unit_time));
+	if(j <= i) j = i+1;
+	while(j > i+1 && tick_of(spe_start,j-1) > tick) --j;
+	while(j < nsamples && tick_of(spe_start,j) == tick) ++j;
+	if(j > nsamples) j = nsamples;
+
+	wf[tick] += (float)(gain * (cumulative[j] - cumulative[i]));
+
+	i = j;
       }
-      std::cout << "  Current local max: " << maxval << " @ " << argmax << " (local vector)" << std::endl;
-      */
     }
 
   }
@@ -146,12 +129,17 @@ namespace opdet {
   //-------------------------------------------------------------------------
   const std::vector<float>& WFAlgoDigitizedSPE::GetSPE(const int opch) const
   //-------------------------------------------------------------------------
-  { return ((opch%100) == fAbnormCh ? fSPE_Abnormal : fSPE_Normal); }
+  { return GetResponse(opch).wf; }
 
   //----------------------------------------------------------------------------
   const ::detinfo::ElecClock& WFAlgoDigitizedSPE::GetClock(const int opch) const
   //----------------------------------------------------------------------------
-  { return ((opch%100) == fAbnormCh ? fSPETime_Abnormal : fSPETime_Normal); }
+  { return GetResponse(opch).time; }
+
+  //-----------------------------------------------------------------------------
+  const SPEResponse& WFAlgoDigitizedSPE::GetResponse(const int opch) const
+  //-----------------------------------------------------------------------------
+  { return ((opch%100) == fAbnormCh ? *fResponse_Abnormal : *fResponse_Normal); }
 
 }
 
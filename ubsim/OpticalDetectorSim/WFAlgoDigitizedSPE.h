@@ -15,7 +15,9 @@
 #define WFALGODIGITIZEDSPE_H
 
 #include "WFAlgoSPEBase.h"
+#include "SPEResponseRegistry.h"
 #include "fhiclcpp/ParameterSet.h"
+#include <memory>
 
 namespace opdet {
 
@@ -52,7 +54,21 @@ namespace opdet {
 
     const ::detinfo::ElecClock& GetClock(const int opch) const;
 
+    /// Function to get the shared SPE response for a channel
+    const SPEResponse& GetResponse(const int opch) const;
+
   private:
+    /**
+       Photon preprocessing for Process: converts all G4 photon times to the SPE start
+       time relative to the waveform start (T0 and its spread applied), drops photons
+       outside the waveform window and sorts the rest so waveform writes are local.
+       The result is stored in fSPEStartTime.
+     */
+    void SelectPhotons(const detinfo::DetectorClocksData& clockData,
+		       const ::detinfo::ElecClock &start_time,
+		       const ::detinfo::ElecClock &spe_time,
+		       const size_t nticks);
+
     /**
        Function to set SPE waveform. The second argument is detinfo::ElecClock which
        period should specify waveform tick size and timing specfies photon time
@@ -62,14 +78,13 @@ namespace opdet {
 		 const ::detinfo::ElecClock &time_info,
 		 const int opch);
 
-    /// SPE waveform
-    std::vector<float> fSPE_Normal;
-    std::vector<float> fSPE_Abnormal;
+    /// SPE response (waveform & timing information) shared through SPEResponseRegistry
+    std::shared_ptr<const SPEResponse> fResponse_Normal;
+    /// SPE response for opch 28 (abnormal) shared through SPEResponseRegistry
+    std::shared_ptr<const SPEResponse> fResponse_Abnormal;
 
-    /// SPE waveform timing information for normal response (tick period & signal timing)
-    detinfo::ElecClock fSPETime_Normal;
-    /// SPE waveform timing information for opch 28 response (tick period & signal timing)
-    detinfo::ElecClock fSPETime_Abnormal;
+    /// In-window SPE start times w.r.t. waveform start (sorted, buffer reused across calls)
+    std::vector<double> fSPEStartTime;
 
   };
 }
@@ -0,0 +1,42 @@
+#ifndef COMPRESS_ADAPTIVETHRESHOLD_CXX
+#define COMPRESS_ADAPTIVETHRESHOLD_CXX
+
+#include "AdaptiveThreshold.h"
+#include "AlgorithmFactory.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace compress {
+
+  AdaptiveThreshold::AdaptiveThreshold(fhicl::ParameterSet const& pset)
+    : MicrobooneFirmware(pset)
+  {
+
+    _nsigma    = pset.get< std::vector<double> >("NSigma");
+    _minThresh = pset.get< std::vector<double> >("MinThresholds");
+
+    if (_nsigma.size() != 3) {
+      throw std::runtime_error("ERROR in AdaptiveThreshold: incorrect size of input for NSigma values.");
+    }
+
+    if (_minThresh.size() != 3) {
+      throw std::runtime_error("ERROR in AdaptiveThreshold: incorrect size of input for MinThresholds values.");
+    }
+
+  }
+
+  double AdaptiveThreshold::Threshold(const FirmwareState& st, int pl) const {
+
+    if (!st.has_base) return _thresh[pl];
+
+    double thresh = std::max(_minThresh[pl], _nsigma[pl] * std::sqrt((double)st.noise));
+
+    return (_thresh[pl] < 0 ? -thresh : thresh);
+  }
+
+  REGISTER_COMPRESSION_ALGO(AdaptiveThreshold);
+
+}
+
+#endif
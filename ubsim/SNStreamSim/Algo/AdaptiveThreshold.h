@@ -0,0 +1,46 @@
+/**
+ * \file AdaptiveThreshold.h
+ *
+ * \ingroup SNCompression
+ * 
+ * \brief SN-stream compression with per-channel thresholds set from the channel noise
+ */
+
+/** \addtogroup SNCompression
+
+    @{*/
+#ifndef COMPRESS_ADAPTIVETHRESHOLD_H
+#define COMPRESS_ADAPTIVETHRESHOLD_H
+
+#include "ubsim/SNStreamSim/Algo/MicrobooneFirmware.h"
+
+namespace compress {
+
+  /**
+     \class AdaptiveThreshold
+     Same baseline finding and ROI padding as MicrobooneFirmware, but the threshold of each
+     channel is NSigma times its noise RMS (never less than MinThresholds), with the sign of
+     the plane CompressThresholds. The noise RMS is the square root of the firmware variance
+     of the block the channel baseline was last taken from. Until a baseline is found the
+     plane CompressThresholds are used.
+  */
+  class AdaptiveThreshold : public MicrobooneFirmware {
+    
+  public:
+
+    AdaptiveThreshold(fhicl::ParameterSet const& pset);
+
+  protected:
+
+    double Threshold(const FirmwareState& st, int pl) const override;
+
+    // threshold in units of the noise RMS, per plane
+    std::vector<double> _nsigma;
+    // lowest threshold magnitude, per plane [ADC]
+    std::vector<double> _minThresh;
+  };
+
+}
+
+#endif
+/** @} */ // end of doxygen group 
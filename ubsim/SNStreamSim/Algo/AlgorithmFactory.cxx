@@ -3,30 +3,48 @@
 
 #include "AlgorithmFactory.h"
 
-// Algorithms
-#include "MicrobooneFirmware.h"
+#include <iostream>
+#include <stdexcept>
 
 namespace compress {
 
+  std::map< std::string, AlgorithmFactory::Maker >& AlgorithmFactory::Registry() {
+    // built on first use: algorithms register during static initialization
+    static std::map< std::string, Maker > registry;
+    return registry;
+  }
+
+  bool AlgorithmFactory::Register(std::string const& name, Maker maker) {
+
+    if (!Registry().emplace(name, std::move(maker)).second)
+      throw std::runtime_error("ERROR in AlgorithmFactory: algorithm " + name + " registered twice.");
+
+    return true;
+  }
+
+  std::vector<std::string> AlgorithmFactory::Names() {
+
+    std::vector<std::string> names;
+    for (auto const& entry : Registry()) names.push_back(entry.first);
+    return names;
+  }
+
   std::unique_ptr< CompressionAlgoBase > AlgorithmFactory::MakeCompressionAlgo(fhicl::ParameterSet const& p) {
 
     std::cout << "creating algorithm" << std::endl;
 
     std::string algname = p.get<std::string>("CompressionAlgoName");
 
-    std::unique_ptr< CompressionAlgoBase > ptr;
+    auto maker = Registry().find(algname);
 
-    if (algname.compare("MicrobooneFirmware") == 0) {
-      std::unique_ptr< CompressionAlgoBase> new_ptr(new MicrobooneFirmware(p) );
-      ptr.swap(new_ptr);
-    }
-    
-    else {
-      std::cout << "Algorithm name provided is " << algname << std::endl;
+    if (maker == Registry().end()) {
+      std::cout << "Algorithm name provided is " << algname << ". Registered algorithms:";
+      for (auto const& name : Names()) std::cout << " " << name;
+      std::cout << std::endl;
       throw std::runtime_error("ERROR in AlgorithmFactory: no registered algorithm by that name.");
     }
 
-    return ptr;
+    return (maker->second)(p);
   }
 
 }
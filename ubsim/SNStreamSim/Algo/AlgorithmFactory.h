@@ -3,6 +3,10 @@
 
 #include <string>
 #include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
 
 // Abstract algorithm class include
 #include "ubsim/SNStreamSim/Fmwk/CompressionAlgoBase.h"
@@ -12,18 +16,40 @@
 
 namespace compress {
 
-
+  /**
+     Makes compression algorithms by the name given in CompressionAlgoName.
+     Algorithms register themselves with REGISTER_COMPRESSION_ALGO in their source file.
+  */
   class AlgorithmFactory {
 
   public:
+
+    /// Function making an algorithm from its configuration
+    typedef std::function< std::unique_ptr< CompressionAlgoBase >(fhicl::ParameterSet const&) > Maker;
     
     AlgorithmFactory() {}
     ~AlgorithmFactory() {}
 
     std::unique_ptr< CompressionAlgoBase > MakeCompressionAlgo(fhicl::ParameterSet const& p);
+
+    /// Register an algorithm under name (returns true, to be used in static initialization)
+    static bool Register(std::string const& name, Maker maker);
+
+    /// Names of all registered algorithms
+    static std::vector<std::string> Names();
+
+  private:
+
+    static std::map< std::string, Maker >& Registry();
   
   };
   
 }
 
+/// Register algorithm class klass (in namespace compress) under its own name
+#define REGISTER_COMPRESSION_ALGO(klass)				\
+  [[maybe_unused]] static const bool klass##_registered =				\
+    compress::AlgorithmFactory::Register(#klass, [](fhicl::ParameterSet const& p) { \
+	return std::unique_ptr< compress::CompressionAlgoBase >(new klass(p)); })
+
 #endif
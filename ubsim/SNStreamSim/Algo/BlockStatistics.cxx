@@ -0,0 +1,156 @@
+#ifndef COMPRESS_BLOCKSTATISTICS_CXX
+#define COMPRESS_BLOCKSTATISTICS_CXX
+
+#include "BlockStatistics.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define COMPRESS_BLOCKSTATS_AVX2
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define COMPRESS_BLOCKSTATS_NEON
+#endif
+
+namespace compress {
+
+  namespace {
+
+    // clamped squared difference as done by the firmware
+    inline int ClampedSquare(int adc, int baseline, int maxADC)
+    {
+      int diff = (adc - baseline) * (adc - baseline);
+      return (diff < maxADC ? diff : maxADC);
+    }
+
+#ifdef COMPRESS_BLOCKSTATS_AVX2
+    __attribute__((target("avx2")))
+    void ComputeBlockStatsAVX2(const short* waveform, size_t first, size_t stride, size_t nblocks,
+			       int block, int maxADC, BlockStats* out)
+    {
+      const int nvec = block / 16;
+      const __m256i ones = _mm256_set1_epi16(1);
+      const __m256i vmax = _mm256_set1_epi32(maxADC);
+
+      for (size_t k = 0; k < nblocks; k++) {
+
+	const short* b = waveform + first + k * stride;
+
+	// sum: 16 ADCs per step, pairwise widened to 32 bit
+	__m256i vsum = _mm256_setzero_si256();
+	for (int i = 0; i < nvec; i++) {
+	  __m256i x = _mm256_loadu_si256((const __m256i*)(b + 16 * i));
+	  vsum = _mm256_add_epi32(vsum, _mm256_madd_epi16(x, ones));
+	}
+	__m128i s = _mm_add_epi32(_mm256_castsi256_si128(vsum), _mm256_extracti128_si256(vsum, 1));
+	s = _mm_hadd_epi32(s, s);
+	s = _mm_hadd_epi32(s, s);
+	int sum = _mm_cvtsi128_si32(s);
+	for (int i = 16 * nvec; i < block; i++) sum += b[i];
+
+	const int baseline = sum >> 6;
+
+	// variance: 8 ADCs per step in 32 bit
+	const __m256i vbase = _mm256_set1_epi32(baseline);
+	__m256i vvar = _mm256_setzero_si256();
+	for (int i = 0; i < 2 * nvec; i++) {
+	  __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(b + 8 * i)));
+	  __m256i d = _mm256_sub_epi32(x, vbase);
+	  vvar = _mm256_add_epi32(vvar, _mm256_min_epi32(_mm256_mullo_epi32(d, d), vmax));
+	}
+	s = _mm_add_epi32(_mm256_castsi256_si128(vvar), _mm256_extracti128_si256(vvar, 1));
+	s = _mm_hadd_epi32(s, s);
+	s = _mm_hadd_epi32(s, s);
+	int var = _mm_cvtsi128_si32(s);
+	for (int i = 16 * nvec; i < block; i++) var += ClampedSquare(b[i], baseline, maxADC);
+
+	out[k].baseline = baseline;
+	out[k].variance = var >> 6;
+      }
+    }
+
+    bool HaveAVX2()
+    {
+      static const bool have = __builtin_cpu_supports("avx2");
+      return have;
+    }
+#endif
+
+#ifdef COMPRESS_BLOCKSTATS_NEON
+    void ComputeBlockStatsNEON(const short* waveform, size_t first, size_t stride, size_t nblocks,
+			       int block, int maxADC, BlockStats* out)
+    {
+      const int nvec = block / 8;
+      const int32x4_t vmax = vdupq_n_s32(maxADC);
+
+      for (size_t k = 0; k < nblocks; k++) {
+
+	const short* b = waveform + first + k * stride;
+
+	int32x4_t vsum = vdupq_n_s32(0);
+	for (int i = 0; i < nvec; i++)
+	  vsum = vpadalq_s16(vsum, vld1q_s16(b + 8 * i));
+	int sum = vaddvq_s32(vsum);
+	for (int i = 8 * nvec; i < block; i++) sum += b[i];
+
+	const int baseline = sum >> 6;
+
+	const int32x4_t vbase = vdupq_n_s32(baseline);
+	int32x4_t vvar = vdupq_n_s32(0);
+	for (int i = 0; i < nvec; i++) {
+	  int16x8_t x = vld1q_s16(b + 8 * i);
+	  int32x4_t lo = vsubq_s32(vmovl_s16(vget_low_s16(x)), vbase);
+	  int32x4_t hi = vsubq_s32(vmovl_s16(vget_high_s16(x)), vbase);
+	  vvar = vaddq_s32(vvar, vminq_s32(vmulq_s32(lo, lo), vmax));
+	  vvar = vaddq_s32(vvar, vminq_s32(vmulq_s32(hi, hi), vmax));
+	}
+	int var = vaddvq_s32(vvar);
+	for (int i = 8 * nvec; i < block; i++) var += ClampedSquare(b[i], baseline, maxADC);
+
+	out[k].baseline = baseline;
+	out[k].variance = var >> 6;
+      }
+    }
+#endif
+
+  }
+
+  void ComputeBlockStatsScalar(const short* waveform, size_t first, size_t stride, size_t nblocks,
+			       int block, int maxADC, BlockStats* out)
+  {
+    for (size_t k = 0; k < nblocks; k++) {
+
+      const short* b = waveform + first + k * stride;
+
+      int sum = 0;
+      for (int i = 0; i < block; i++) sum += b[i];
+      const int baseline = sum >> 6;
+
+      int var = 0;
+      for (int i = 0; i < block; i++) var += ClampedSquare(b[i], baseline, maxADC);
+
+      out[k].baseline = baseline;
+      out[k].variance = var >> 6;
+    }
+  }
+
+  void ComputeBlockStats(const short* waveform, size_t first, size_t stride, size_t nblocks,
+			 int block, int maxADC, BlockStats* out)
+  {
+#ifdef COMPRESS_BLOCKSTATS_AVX2
+    if (HaveAVX2()) {
+      ComputeBlockStatsAVX2(waveform, first, stride, nblocks, block, maxADC, out);
+      return;
+    }
+#endif
+#ifdef COMPRESS_BLOCKSTATS_NEON
+    ComputeBlockStatsNEON(waveform, first, stride, nblocks, block, maxADC, out);
+    return;
+#endif
+    ComputeBlockStatsScalar(waveform, first, stride, nblocks, block, maxADC, out);
+  }
+
+}
+
+#endif
@@ -0,0 +1,42 @@
+/**
+ * \file BlockStatistics.h
+ *
+ * \ingroup SNCompression
+ * 
+ * \brief Block baseline/variance kernel of the MicroBooNE SN-stream firmware
+ */
+
+/** \addtogroup SNCompression
+
+    @{*/
+#ifndef COMPRESS_BLOCKSTATISTICS_H
+#define COMPRESS_BLOCKSTATISTICS_H
+
+#include <cstddef>
+
+namespace compress {
+
+  /// Baseline & variance of one block, in firmware integer units
+  struct BlockStats {
+    int baseline;
+    int variance;
+  };
+
+  /**
+     Computes the statistics of nblocks blocks of block ticks, the k-th one starting at
+     waveform[first + k*stride], with the firmware integer arithmetic:
+     baseline = (sum of ADCs) >> 6, variance = (sum of min((ADC-baseline)^2, maxADC)) >> 6.
+     Uses AVX2 (x86-64, chosen at run time) or NEON (AArch64) when available; results are
+     bit-identical to ComputeBlockStatsScalar.
+  */
+  void ComputeBlockStats(const short* waveform, size_t first, size_t stride, size_t nblocks,
+			 int block, int maxADC, BlockStats* out);
+
+  /// Scalar reference implementation of ComputeBlockStats
+  void ComputeBlockStatsScalar(const short* waveform, size_t first, size_t stride, size_t nblocks,
+			       int block, int maxADC, BlockStats* out);
+
+}
+
+#endif
+/** @} */ // end of doxygen group 
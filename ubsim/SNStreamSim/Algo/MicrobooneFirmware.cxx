@@ -2,8 +2,13 @@
 #define MICROBOONEFIRMWARE_CXX
 
 #include "MicrobooneFirmware.h"
+#include "BlockStatistics.h"
+#include "AlgorithmFactory.h"
 #include <limits>
 #include <cstddef>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
 
 namespace compress {
   
@@ -64,61 +69,119 @@ namespace compress {
   }
   
   
-  void MicrobooneFirmware::ApplyCompression(const std::vector<short> &waveform, const int mode, const unsigned int ch){
-    
-    // iterator to the beginning and end of the waveform
-    _begin = waveform.begin();
-    _end   = waveform.end();
-    
-    std::vector<short> outputwf;
-    _baselines.clear();
-    _variances.clear();
-    
-    unsigned int _baseline[3];
-    unsigned int _variance[3];
-    _baseline[0] = std::numeric_limits<unsigned int>::max();
-    _baseline[1] = std::numeric_limits<unsigned int>::max();
-    _baseline[2] = std::numeric_limits<unsigned int>::max();
-    _variance[0] = std::numeric_limits<unsigned int>::max();
-    _variance[1] = std::numeric_limits<unsigned int>::max();
-    _variance[2] = std::numeric_limits<unsigned int>::max();
+  MicrobooneFirmware::FirmwareState::FirmwareState()
+  {
+    for (size_t i = 0; i < 3; i++){
+      baseline[i] = std::numeric_limits<unsigned int>::max();
+      variance[i] = std::numeric_limits<unsigned int>::max();
+    }
+  }
+  
+  
+  size_t MicrobooneFirmware::ApplyCompression(const short* waveform, const size_t nticks,
+					      const int mode, const unsigned int ch,
+					      std::vector<compress::tick_range>& ranges){
     
-    // Tick @ which waveform starts
-    int start = 0;
+    ranges.clear();
+
+    if (_debug) { std::cout << "\t algo operating on wf of size " << nticks << std::endl; }
+
+    // the state is sized by SetNChannels before any concurrent call: never resized here
+    if (ch >= _states.size())
+      throw std::runtime_error("ERROR in MicrobooneFirmware: channel " + std::to_string(ch) +
+			       " is outside the " + std::to_string(_states.size()) + " channels set with SetNChannels.");
+    FirmwareState& chstate = _states[ch];
+
+    if (!_streaming){
+      // every waveform is a stream of its own: only the baseline is kept
+      FirmwareState st;
+      st.has_base = chstate.has_base;
+      st.base     = chstate.base;
+      st.noise    = chstate.noise;
+      size_t lost = Process(waveform, nticks, mode, st, ranges);
+      chstate.has_base = st.has_base;
+      chstate.base     = st.base;
+      chstate.noise    = st.noise;
+      return lost;
+    }
 
-    // start & end tick for each Region Of Interest (ROI) saved
-    tick s;
-    tick e;
-    std::pair<tick,tick> thisRange; 
-    
-    _pl = mode;
+    // the first frame needs blocks 1 and 2, any frame needs the look-ahead of the previous one
+    if (nticks < 2 * (size_t)_block)
+      throw std::runtime_error("ERROR in MicrobooneFirmware: frame shorter than two blocks in streaming mode.");
+
+    return Process(waveform, nticks, mode, chstate, ranges);
+  }
+
+
+  size_t MicrobooneFirmware::Process(const short* waveform, const size_t nticks, const int pl,
+				     FirmwareState& st, std::vector<compress::tick_range>& ranges) const {
+
+    // statistics of all blocks of the current waveform (buffer reused across channels)
+    thread_local std::vector<BlockStats> blockStats;
+
+    size_t lost = 0;
+
+    // stream ticks of the first sample of this frame and one past the last
+    const size_t offset = st.offset;
+    const size_t end    = offset + nticks;
+
+    const size_t stride = _block - 1;
+    const size_t pre    = _buffer[pl][0];
+    const size_t post   = _buffer[pl][1];
+
+    // threshold in use: only changes with the baseline
+    double thresh = Threshold(st, pl);
 
-    if (_debug) { std::cout << "\t algo operating on wf of size " << waveform.size() << std::endl; }
+    // post-padding of the last ROI that runs into this frame
+    if (st.roi_end > offset) lost += AddRange(st, offset, st.roi_end, end, ranges);
 
-    for (size_t n = 0; n < waveform.size(); n++) {
+    // complete the look-ahead blocks of boundaries left at the end of the previous frame.
+    // The baseline update of these boundaries comes late: ticks since then used the old one.
+    if (!st.pending.empty()){
+      const size_t carry_start = st.pending.front() + 1;
+      st.carry.insert(st.carry.end(), waveform, waveform + (st.pending.back() + 1 + _block - offset));
+      for (auto const& b : st.pending){
+	BlockStats next;
+	ComputeBlockStats(st.carry.data(), b + 1 - carry_start, stride, 1, _block, _maxADC, &next);
+	ShiftBlocks(st, next);
+	UpdateBaseline(st);
+      }
+      thresh = Threshold(st, pl);
+      st.pending.clear();
+      st.carry.clear();
+    }
+
+    // 1st pass: statistics of every block that enters the 3-block window.
+    // Blocks are evaluated at ticks n = k * (_block - 1) and span [n+1, n+1+_block).
+    size_t nstats = 0;
+    if (end > st.next_boundary + _block) nstats = (end - st.next_boundary - _block - 1) / stride + 1;
+    blockStats.resize(nstats);
+    ComputeBlockStats(waveform, st.next_boundary + 1 - offset, stride, nstats, _block, _maxADC, blockStats.data());
+
+    // 2nd pass: threshold crossing
+    size_t k = 0;
+
+    for (size_t n = 0; n < nticks; n++) {
 
-      _thisTick = _begin + n;
+      const size_t tick = offset + n;
 
       // have we reached the end of a segment?
-      if (n % (_block - 1) == 0){
+      if (tick == st.next_boundary){
 
-	if (_debug) { std::cout << "\t\t reached end of segment @ tick " << n << std::endl; }
+	st.next_boundary += stride;
+
+	if (_debug) { std::cout << "\t\t reached end of segment @ tick " << tick << std::endl; }
 
 	// is this the 1st block? if so calculate mean and variance
-	if ( (n + 1 - _block) == 0){
+	if ( (tick + 1) == (size_t)_block ){
+	  // block 1 baseline is a true division (not a shift) in the firmware
 	  int baseline = 0;
 	  int var  = 0;
-	  int diff = 0;
-	  tick t = _thisTick - _block + 1;
-	  // int mm = 0; // unused
-	  for (; t < _thisTick + 1; t++){
-	    baseline += *t;
-	    // mm += 1; // unused
-	  }
+	  for (size_t t = 0; t < n + 1; t++)
+	    baseline += waveform[t];
 	  baseline /= _block;
-	  t = _thisTick - _block + 1;
-	  for (; t < _thisTick + 1; t++){
-	    diff = ( (*t) - baseline ) * ( (*t) - baseline );
+	  for (size_t t = 0; t < n + 1; t++){
+	    int diff = ( waveform[t] - baseline ) * ( waveform[t] - baseline );
 	    if (diff < _maxADC) var += diff;
 	    else var += _maxADC;
 	  }
@@ -127,136 +190,66 @@ namespace compress {
 	    std::cout << "\t\t B for block 1 : " << baseline << std::endl;
 	    std::cout << "\t\t V for block 1 : " << var      << std::endl;
 	  }
-	  _baseline[1] = baseline;
-	  _variance[1] = var;
-
-	  baseline = 0;
-	  var      = 0;
-	  diff     = 0;
-	  t = _thisTick + 1;
-	  for (; t < _thisTick + _block + 1; t++)
-	    baseline += *t;
-	  baseline = baseline >> 6;
-	  t = _thisTick + 1;
-	  // int nn = 0; // unused
-	  for (; t < _thisTick + _block + 1; t++){
-	    diff = ( (*t) - baseline ) * ( (*t) - baseline );
-	    if (diff < _maxADC) var += diff;
-	    else var += _maxADC;
-	    // nn += 1; // unused
-	  }
-	  var = var >> 6;
+	  st.baseline[1] = baseline;
+	  st.variance[1] = var;
+
+	  // block 2 spans [n+1, n+1+_block), i.e. the k-th block
+	  BlockStats block2;
+	  if (k < nstats) block2 = blockStats[k];
+	  else ComputeBlockStats(waveform, n + 1, stride, 1, _block, _maxADC, &block2);
 	  if (_debug){
-	    std::cout << "\t\t B for block 2 : " << baseline << std::endl;
-	    std::cout << "\t\t V for block 2 : " << var      << std::endl;
+	    std::cout << "\t\t B for block 2 : " << block2.baseline << std::endl;
+	    std::cout << "\t\t V for block 2 : " << block2.variance << std::endl;
 	  }
-	  _baseline[2] = baseline;
-	  _variance[2] = var;
+	  st.baseline[2] = block2.baseline;
+	  st.variance[2] = block2.variance;
 	}// 1st block updating
 
-	// always compute baseline and variance for next block, if it exists
-	if ( (n + _block) < waveform.size() ){
-	  int baseline = 0;
-	  int var      = 0;
-	  int diff     = 0;
-	  tick t = _thisTick + 1;
-	  for (; t < _thisTick + _block + 1; t++)
-	    baseline += *t;
-	  baseline = baseline >> 6;
-	  t = _thisTick + 1;
-	  for (; t < _thisTick + _block + 1; t++){
-	    diff = ( (*t) - baseline ) * ( (*t) - baseline );
-	    if (diff < _maxADC) var += diff;
-	    else var += _maxADC;
-	  }
-	  var = var >> 6;
+	// always use baseline and variance for next block, if it exists
+	bool deferred = false;
+	if ( k < nstats ){
 
 	  if (_debug){
-	    std::cout << "\t\t B for block 3 : " << baseline << std::endl;
-	    std::cout << "\t\t V for block 3 : " << var      << std::endl;
+	    std::cout << "\t\t B for block 3 : " << blockStats[k].baseline << std::endl;
+	    std::cout << "\t\t V for block 3 : " << blockStats[k].variance << std::endl;
 	  }
 
-	  // update baselines and variances
-
-	  // shift baselines and variances by 1 to accomodate
-	  // for the new value from the last block
-	  _baseline[0] = _baseline[1];
-	  _variance[0] = _variance[1];
-	  _baseline[1] = _baseline[2];
-	  _variance[1] = _variance[2];
-	  // add the newly calculated value
-	  // to the last element
-	  _baseline[2] = baseline;
-	  _variance[2] = var;
+	  ShiftBlocks(st, blockStats[k]);
 
 	}// if we are updating the NEXT block
-
-	if (_debug){
-	  std::cout << "Baseline. Block 1: " << _baseline[0] << "\tBlock 2: " << _baseline[1] << "\tBlock 3: " << _baseline[2] << std::endl;
-	  std::cout << "Variance. Block 1: " << _variance[0] << "\tBlock 2: " << _variance[1] << "\tBlock 3: " << _variance[2] << std::endl;
+	else if (_streaming){
+	  // the next block ends in the next frame: update once it has arrived
+	  st.pending.push_back(tick);
+	  deferred = true;
 	}
 
+	k++;
 
-	// Determine if the 3 blocks are quiet enough to update the baseline
-	if ( ( (_baseline[2] - _baseline[1]) * (_baseline[2] - _baseline[1]) < _deltaB ) && 
-	     ( (_baseline[2] - _baseline[0]) * (_baseline[2] - _baseline[0]) < _deltaB ) && 
-	     ( (_baseline[1] - _baseline[0]) * (_baseline[1] - _baseline[0]) < _deltaB ) &&
-	     ( (_variance[2] - _variance[1]) * (_variance[2] - _variance[1]) < _deltaV ) &&
-	     ( (_variance[2] - _variance[0]) * (_variance[2] - _variance[0]) < _deltaV ) &&
-	     ( (_variance[1] - _variance[0]) * (_variance[1] - _variance[0]) < _deltaV ) ){
-	  _baselineMap[ch] = _baseline[1];
-	  if (_debug) std::cout << "Baseline updated to value " << _baselineMap[ch] << std::endl;
+	if (!deferred) {
+	  UpdateBaseline(st);
+	  thresh = Threshold(st, pl);
 	}
       }// if we hit the end of a new block
 
-      _v1 = _variance[0];
-      _v2 = _variance[1];
-      _v3 = _variance[2];
-      _b1 = _baseline[0];
-      _b2 = _baseline[1];
-      _b3 = _baseline[2];
-
-      
-      if ( (_baselineMap.find(ch) != _baselineMap.end()) ){
-	
-	double base = _baselineMap[ch];
+      if ( st.has_base ){
 	
-	// reset maxima
-	_max = 0;
-
 	// Then go through the 3 blocks again trying to find a waveform to save
 	
-	// save will keep track of tick at which waveform goes above threshold
-	// == 0 if not -> use as logic method to decide if to push back or not
-	_save = 0;
-	// also keep track of each new sub-waveform to push back to output waveform
-	outputwf.clear();
-	
-	// loop over central block to search for above-threshold regions
-	
-
-	//for (t = _thisTick + _block; t < _thisTick + 2 * _block; t++){
-	
-	tick t = _thisTick;
-	
-	double thisADC = *t;
-	if (thisADC-base > _max) { _max = thisADC-base; }
+	const double base = st.base;
+	double thisADC = waveform[n];
 	
-	if ( PassThreshold(thisADC, base) ){
+	if ( PassThreshold(thisADC, base, thresh, pl) ){
 	  if (_verbose) { std::cout << "+ "; }
-	  _save = 1;
 	  // yay -> active
 	  // if start == 0 it means it's a new pulse! (previous tick was quiet)
 	  // keep track of maxima
-	  if ( start == 0 ){
-	    start = int(t-_begin);
+	  if ( st.start == 0 ){
+	    st.start = tick;
 	    // also, since we just started...add "backwards ticks" to account for padding
-	    if ( (t-_buffer[mode][0]) > _begin) { s = t-_buffer[mode][0]; }
-	    else { s = _begin; }
-	    if (_verbose) { std::cout << "found start-tick " << s-_begin << std::endl; }
+	    if ( tick > pre ) { st.s = tick - pre; }
+	    else { st.s = 0; }
+	    if (_verbose) { std::cout << "found start-tick " << st.s << std::endl; }
 	  }
-	  // add bin content to temporary output waveform
-	  outputwf.push_back(*t);
 	}
 	
 	else{
@@ -265,66 +258,143 @@ namespace compress {
 	  // 1) we were in a sub-threshold region at the previous tick -> then just carry on
 	  // 2) we were in an active region in the previous tick -> we just "finished" this mini-waveform.
 	  //    then Complete padding and save to output
-	  if ( start > 0 ){
-	    // finish padding
-	    if ( (t+_buffer[mode][1]) < _end) { e = t+_buffer[mode][1]; }
-	    else { e = _end; }
+	  if ( st.start > 0 ){
+	    // finish padding. In streaming mode it may run into the next frame
+	    size_t e = tick + post;
+	    if ( !_streaming && e > end ) { e = end; }
 	    // push back waveform and time-tick
 	    if (_verbose) {
 	      std::cout << std::endl;
-	      std::cout << "saving [" << s-_begin << ", " << e-_begin << "]" << std::endl;
-	    }
-	    // if the beginning is before the end of the previous section -> just expand
-	    if (_timeRange.size() > 0){
-	      if (s < _timeRange.back().second){
-		// this new range starts before the last one ends -> edit the last one
-		_timeRange.back().second = e;
-	      }
-	      else{
-		thisRange = std::make_pair(s,e);
-		_timeRange.push_back(thisRange);
-	      }
-	    }
-	    else{
-	      thisRange = std::make_pair(s,e);
-	      _timeRange.push_back(thisRange);
+	      std::cout << "saving [" << st.s << ", " << e << "]" << std::endl;
 	    }
-	    _save = 0;
-	    start = 0;
+	    lost += AddRange(st, st.s, e, end, ranges);
+	    st.start = 0;
 	  }
 	}
       }
 
     }// for all ticks
 
+    // a pulse still above threshold at the end of the frame
+    if ( st.start > 0 ){
+      if (_streaming){
+	// save what we have so far and carry on with the rest of the pulse in the next frame
+	lost += AddRange(st, st.s, end, end, ranges);
+	st.s = end;
+      }
+      else{
+	// never closed: lost
+	size_t saved = ( ranges.size() > 0 ? offset + ranges.back().second : 0 );
+	lost += end - std::max(st.s, saved);
+      }
+    }
+
+    // keep the samples of the pending look-ahead blocks seen so far
+    if (!st.pending.empty())
+      st.carry.assign(waveform + (st.pending.front() + 1 - offset), waveform + nticks);
+
+    st.offset = end;
+
+    return lost;
+  }
+
+
+  void MicrobooneFirmware::ShiftBlocks(FirmwareState& st, const BlockStats& next){
+
+    // shift baselines and variances by 1 to accomodate
+    // for the new value from the last block
+    st.baseline[0] = st.baseline[1];
+    st.variance[0] = st.variance[1];
+    st.baseline[1] = st.baseline[2];
+    st.variance[1] = st.variance[2];
+    // add the newly calculated value
+    // to the last element
+    st.baseline[2] = next.baseline;
+    st.variance[2] = next.variance;
+
     return;
   }
 
 
-  bool MicrobooneFirmware::PassThreshold(double thisADC, double base){
+  void MicrobooneFirmware::UpdateBaseline(FirmwareState& st) const {
+
+    const unsigned int* _baseline = st.baseline;
+    const unsigned int* _variance = st.variance;
+
+    if (_debug){
+      std::cout << "Baseline. Block 1: " << _baseline[0] << "\tBlock 2: " << _baseline[1] << "\tBlock 3: " << _baseline[2] << std::endl;
+      std::cout << "Variance. Block 1: " << _variance[0] << "\tBlock 2: " << _variance[1] << "\tBlock 3: " << _variance[2] << std::endl;
+    }
+
+    // Determine if the 3 blocks are quiet enough to update the baseline
+    if ( ( (_baseline[2] - _baseline[1]) * (_baseline[2] - _baseline[1]) < _deltaB ) && 
+	 ( (_baseline[2] - _baseline[0]) * (_baseline[2] - _baseline[0]) < _deltaB ) && 
+	 ( (_baseline[1] - _baseline[0]) * (_baseline[1] - _baseline[0]) < _deltaB ) &&
+	 ( (_variance[2] - _variance[1]) * (_variance[2] - _variance[1]) < _deltaV ) &&
+	 ( (_variance[2] - _variance[0]) * (_variance[2] - _variance[0]) < _deltaV ) &&
+	 ( (_variance[1] - _variance[0]) * (_variance[1] - _variance[0]) < _deltaV ) ){
+      st.base = _baseline[1];
+      st.noise = _variance[1];
+      st.has_base = true;
+      if (_debug) std::cout << "Baseline updated to value " << st.base << std::endl;
+    }
+
+    return;
+  }
 
-    if (_pol[_pl] == 0){ //unipolar setting set at command line
+
+  size_t MicrobooneFirmware::AddRange(FirmwareState& st, size_t s, size_t e, const size_t end,
+				      std::vector<compress::tick_range>& ranges) const {
+
+    const size_t offset = st.offset;
+    size_t lost = 0;
+
+    // padding before the start of the frame belongs to a frame already written out:
+    // whatever was not saved with it is lost
+    if (s < offset){
+      size_t saved = std::min(std::max(st.roi_end, s), offset);
+      lost = offset - saved;
+      s = offset;
+    }
+    st.roi_end = std::max(st.roi_end, e);
+    if (e > end) e = end;
+    if (e <= s) return lost;
+
+    // if the beginning is before the end of the previous section -> just expand
+    if ( ranges.size() > 0 && (s - offset) < ranges.back().second )
+      // this new range starts before the last one ends -> edit the last one
+      ranges.back().second = std::max(ranges.back().second, e - offset);
+    else
+      ranges.push_back(std::make_pair(s - offset, e - offset));
+
+    return lost;
+  }
+
+
+  bool MicrobooneFirmware::PassThreshold(double thisADC, double base, double thresh, int pl) const {
+
+    if (_pol[pl] == 0){ //unipolar setting set at command line
 
         //if positive threshold
-	  if (_thresh[_pl] >= 0){
-          if (thisADC > base + _thresh[_pl])
+	  if (thresh >= 0){
+          if (thisADC > base + thresh)
     	return true;
        }
 
 	// if negative threshold
         else{
-          if (thisADC < base + _thresh[_pl])
+          if (thisADC < base + thresh)
     	return true;
         }
 
 	  }
 
     else { //bipolar setting set at command line
-	  if  (thisADC >= base + _thresh[_pl]) {
+	  if  (thisADC >= base + thresh) {
 	    return true;
 	  }
 
-	  if (thisADC <= base - _thresh[_pl]) {
+	  if (thisADC <= base - thresh) {
 	      return true;
 	    }
 	  }
@@ -332,5 +402,7 @@ namespace compress {
     return false;
   }
   
+  REGISTER_COMPRESSION_ALGO(MicrobooneFirmware);
+
 }
 #endif
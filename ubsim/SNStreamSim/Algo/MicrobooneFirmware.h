@@ -15,7 +15,9 @@
 #define MICROBOONEFIRMWARE_H
 
 #include "ubsim/SNStreamSim/Fmwk/CompressionAlgoBase.h"
+#include "ubsim/SNStreamSim/Algo/BlockStatistics.h"
 #include <math.h>
+#include <vector>
 
 namespace compress {
 
@@ -30,17 +32,72 @@ namespace compress {
     MicrobooneFirmware(fhicl::ParameterSet const& pset);
     
     /// Function where compression is performed
-    void ApplyCompression(const std::vector<short> &waveform, const int mode, const unsigned int ch);
+    size_t ApplyCompression(const short* waveform, const size_t nticks,
+			    const int mode, const unsigned int ch,
+			    std::vector<compress::tick_range>& ranges);
 
+    /// Allocate the state of channels [0, nchannels)
+    void SetNChannels(size_t nchannels) { if (nchannels > _states.size()) _states.resize(nchannels); }
 
+    /// Forget the stream state and baseline of all channels
+    void ResetStreams() { _states.assign(_states.size(), FirmwareState()); }
 
     // Decide if to fill tree with info or not
     void SetFillTree(bool on) { _fillTree = on; }
 
   protected:
 
+    /**
+       State of the firmware on one channel. In streaming mode it is carried from one frame
+       to the next; all ticks are counted from the start of the stream. Otherwise only the
+       baseline is kept from one waveform to the next.
+    */
+    struct FirmwareState {
+      /// Channel baseline, once a quiet region has been found, and the variance of its block
+      bool has_base = false;
+      int  base = 0;
+      unsigned int noise = 0;
+      /// Baselines & variances of the 3 blocks in the window
+      unsigned int baseline[3];
+      unsigned int variance[3];
+      /// Tick of the first sample of the next frame
+      size_t offset = 0;
+      /// Tick of the next block boundary
+      size_t next_boundary = 0;
+      /// Boundaries whose look-ahead block runs into the next frame, and the samples seen so far
+      std::vector<size_t> pending;
+      std::vector<short>  carry;
+      /// Tick at which the open ROI went above threshold (0 if none) and its padded start
+      size_t start = 0;
+      size_t s = 0;
+      /// End of the last ROI (its post-padding may run into the next frame)
+      size_t roi_end = 0;
+      FirmwareState();
+    };
+
+    /**
+       Run the firmware on one frame of a channel of plane pl, starting from (and updating)
+       state st. Only reads the configuration: may run concurrently on different states.
+       Returns the number of ROI ticks lost.
+    */
+    size_t Process(const short* waveform, const size_t nticks, const int pl,
+		   FirmwareState& st, std::vector<compress::tick_range>& ranges) const;
+
+    /// Add the statistics of the next block to the 3-block window
+    static void ShiftBlocks(FirmwareState& st, const BlockStats& next);
+
+    /// Update the channel baseline if the 3 blocks in the window are quiet enough
+    void UpdateBaseline(FirmwareState& st) const;
+
+    /// Save ROI [s,e) (stream ticks) clipped to the frame [offset,end) of state st. Returns the ticks lost
+    size_t AddRange(FirmwareState& st, size_t s, size_t e, const size_t end,
+		    std::vector<compress::tick_range>& ranges) const;
+
+    /// Threshold to use on a channel of plane pl in state st (the plane threshold by default)
+    virtual double Threshold(const FirmwareState& st, int pl) const { return _thresh[pl]; }
+
     /// Function that determines if we passed the threshold. Per plane
-    bool PassThreshold(double thisADC, double base);
+    bool PassThreshold(double thisADC, double base, double thresh, int pl) const;
 
     // setter function for algo specifications
     void SetCompressThresh(int tU, int tV, int tY) { _thresh[0] = tU; _thresh[1] = tV; _thresh[2] = tY; }
@@ -64,21 +121,14 @@ namespace compress {
     // what is the dynamic range of the ADC? This is the MAX ADC tick value.
     int _maxADC;
 
-    // Keep track of the per-channel baseline in a map
-    // The baseline will be re-set per run.
+    // Keep track of the per-channel state (and baseline) in a dense array indexed by channel.
     // If the baseline is not found in the first 3 blocks
     // (because noisy) then no output can be saved.
     // this will go on until a quiet region in the run is found
-    std::map<int, int> _baselineMap;
+    std::vector<FirmwareState> _states;
 
     // boolean to decide if to fill tree
     bool _fillTree;
-    int _pl;
-    int _v1, _v2, _v3;
-    int _b1, _b2, _b3;
-    double _max;
-    int _interesting;
-    int _save;
   };
 
 }
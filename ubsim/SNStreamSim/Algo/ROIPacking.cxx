@@ -0,0 +1,184 @@
+#ifndef COMPRESS_ROIPACKING_CXX
+#define COMPRESS_ROIPACKING_CXX
+
+#include "ROIPacking.h"
+#include <stdexcept>
+
+namespace compress {
+
+  namespace {
+
+    const uint16_t kFrameMarker   = 0xFFFF;
+    const uint16_t kChannelMarker = 0x4000;
+    const uint16_t kROIMarker     = 0x8000;
+
+    // differences with a Huffman code: the code of kDiffs[i] is i 0s followed by a 1
+    const int kDiffs[7] = { 0, 1, -1, 2, -2, 3, -3 };
+    // code of a sample written as it is
+    const int kEscape = 7;
+
+    inline int DiffCode(int diff)
+    {
+      switch (diff) {
+      case  0: return 0;
+      case  1: return 1;
+      case -1: return 2;
+      case  2: return 3;
+      case -2: return 4;
+      case  3: return 5;
+      case -3: return 6;
+      default: return kEscape;
+      }
+    }
+
+    inline uint16_t Sample(short adc)
+    {
+      if (adc < 0 || adc > 0xFFF)
+	throw std::runtime_error("ERROR in PackChannel: sample outside the 12-bit ADC range.");
+      return (uint16_t)adc;
+    }
+
+    // writes bits MSB-first into 16-bit words
+    class BitWriter {
+    public:
+      BitWriter(std::vector<uint16_t>& out) : _out(out), _acc(0), _nbits(0) {}
+      void Put(uint32_t bits, int n)
+      {
+	_acc = (_acc << n) | bits;
+	_nbits += n;
+	while (_nbits >= 16) {
+	  _nbits -= 16;
+	  _out.push_back((uint16_t)(_acc >> _nbits));
+	}
+      }
+      void Flush()
+      {
+	if (_nbits > 0) _out.push_back((uint16_t)(_acc << (16 - _nbits)));
+	_acc = 0;
+	_nbits = 0;
+      }
+    private:
+      std::vector<uint16_t>& _out;
+      uint64_t _acc;
+      int _nbits;
+    };
+
+    // reads bits MSB-first from 16-bit words
+    class BitReader {
+    public:
+      BitReader(const uint16_t* words, size_t nwords) : _words(words), _nwords(nwords), _pos(0), _bit(0) {}
+      uint32_t Get(int n)
+      {
+	uint32_t bits = 0;
+	for (int i = 0; i < n; i++) {
+	  if (_pos >= _nwords) throw std::runtime_error("ERROR in UnpackFrame: truncated ROI data.");
+	  bits = (bits << 1) | ((_words[_pos] >> (15 - _bit)) & 1);
+	  if (++_bit == 16) { _bit = 0; _pos++; }
+	}
+	return bits;
+      }
+      /// words used so far, including a partially read one
+      size_t Used() const { return _pos + (_bit > 0 ? 1 : 0); }
+    private:
+      const uint16_t* _words;
+      size_t _nwords;
+      size_t _pos;
+      int _bit;
+    };
+
+  }
+
+  void PackFrameHeader(uint32_t frame, size_t nchannels, std::vector<uint16_t>& out)
+  {
+    if (nchannels > 0xFFFF)
+      throw std::runtime_error("ERROR in PackFrameHeader: too many channels for one frame.");
+    out.push_back(kFrameMarker);
+    out.push_back((uint16_t)(frame >> 16));
+    out.push_back((uint16_t)(frame & 0xFFFF));
+    out.push_back((uint16_t)nchannels);
+  }
+
+  void PackChannel(unsigned int ch, const short* adcs, const std::vector<compress::tick_range>& ranges,
+		   std::vector<uint16_t>& out)
+  {
+    if (ch >= kChannelMarker || ranges.size() > 0xFFFF)
+      throw std::runtime_error("ERROR in PackChannel: channel record does not fit the format.");
+
+    out.push_back(kChannelMarker | ch);
+    out.push_back((uint16_t)ranges.size());
+
+    for (auto const& range : ranges) {
+
+      const size_t nsamples = range.second - range.first;
+      if (range.first >= 0x7FFF || nsamples == 0 || nsamples > 0xFFFF)
+	throw std::runtime_error("ERROR in PackChannel: ROI does not fit the format.");
+
+      out.push_back(kROIMarker | range.first);
+      out.push_back((uint16_t)nsamples);
+      out.push_back(Sample(adcs[range.first]));
+
+      BitWriter bits(out);
+      for (size_t t = range.first + 1; t < range.second; t++) {
+	int code = DiffCode(adcs[t] - adcs[t-1]);
+	// code i is i 0s followed by a 1
+	bits.Put(1, code + 1);
+	if (code == kEscape) bits.Put(Sample(adcs[t]), 12);
+      }
+      bits.Flush();
+    }
+  }
+
+  size_t UnpackFrame(const uint16_t* words, size_t nwords, uint32_t& frame, std::vector<PackedROI>& rois)
+  {
+    if (nwords < 4 || words[0] != kFrameMarker)
+      throw std::runtime_error("ERROR in UnpackFrame: frame header not found.");
+
+    frame = ((uint32_t)words[1] << 16) | words[2];
+    const size_t nchannels = words[3];
+    size_t pos = 4;
+
+    for (size_t c = 0; c < nchannels; c++) {
+
+      if (pos + 2 > nwords || (words[pos] & 0xC000) != kChannelMarker)
+	throw std::runtime_error("ERROR in UnpackFrame: channel header not found.");
+      const unsigned int ch = words[pos] & 0x3FFF;
+      const size_t nroi = words[pos+1];
+      pos += 2;
+
+      for (size_t r = 0; r < nroi; r++) {
+
+	if (pos + 3 > nwords || (words[pos] & 0x8000) != kROIMarker)
+	  throw std::runtime_error("ERROR in UnpackFrame: ROI header not found.");
+
+	PackedROI roi;
+	roi.channel = ch;
+	roi.start   = words[pos] & 0x7FFF;
+	const size_t nsamples = words[pos+1];
+	roi.adcs.reserve(nsamples);
+	roi.adcs.push_back((short)(words[pos+2] & 0xFFF));
+	pos += 3;
+
+	BitReader bits(words + pos, nwords - pos);
+	while (roi.adcs.size() < nsamples) {
+	  // count the 0s before the next 1
+	  int code = 0;
+	  while (code < kEscape && bits.Get(1) == 0) code++;
+	  if (code == kEscape) {
+	    if (bits.Get(1) != 1) throw std::runtime_error("ERROR in UnpackFrame: invalid Huffman code.");
+	    roi.adcs.push_back((short)bits.Get(12));
+	  }
+	  else
+	    roi.adcs.push_back(roi.adcs.back() + kDiffs[code]);
+	}
+	pos += bits.Used();
+
+	rois.push_back(std::move(roi));
+      }
+    }
+
+    return pos;
+  }
+
+}
+
+#endif
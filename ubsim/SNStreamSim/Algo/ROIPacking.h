@@ -0,0 +1,56 @@
+/**
+ * \file ROIPacking.h
+ *
+ * \ingroup SNCompression
+ * 
+ * \brief Packed binary format of the ROIs saved by the SN-stream compression
+ */
+
+/** \addtogroup SNCompression
+
+    @{*/
+#ifndef COMPRESS_ROIPACKING_H
+#define COMPRESS_ROIPACKING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ubsim/SNStreamSim/Fmwk/CompressionAlgoBase.h"
+
+namespace compress {
+
+  /*
+    The format is made of 16-bit words, like the SN-stream data out of the TPC readout:
+
+    frame   : 0xFFFF, frame number (2 words, high first), number of channel records
+    channel : 0x4000 | channel, number of ROIs
+    ROI     : 0x8000 | start tick, number of samples, 1st sample (12 bits),
+              then the differences between consecutive samples, Huffman coded and packed
+              MSB-first into as many words as needed (the last one is padded with 0s).
+
+    Huffman codes: 0 -> 1, +1 -> 01, -1 -> 001, +2 -> 0001, -2 -> 00001, +3 -> 000001,
+    -3 -> 0000001. Any other difference is 00000001 followed by the sample itself (12 bits).
+  */
+
+  /// Append the header of a frame with nchannels channel records to out
+  void PackFrameHeader(uint32_t frame, size_t nchannels, std::vector<uint16_t>& out);
+
+  /// Append the record of channel ch to out: its ROIs are read from the ADCs in place
+  void PackChannel(unsigned int ch, const short* adcs, const std::vector<compress::tick_range>& ranges,
+		   std::vector<uint16_t>& out);
+
+  /// One ROI read back from a packed frame
+  struct PackedROI {
+    unsigned int channel;
+    size_t start;
+    std::vector<short> adcs;
+  };
+
+  /// Unpack the frame starting at words[0] (ROIs appended to rois). Returns the number of words read
+  size_t UnpackFrame(const uint16_t* words, size_t nwords, uint32_t& frame, std::vector<PackedROI>& rois);
+
+}
+
+#endif
+/** @} */ // end of doxygen group 
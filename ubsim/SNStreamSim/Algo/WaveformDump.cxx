@@ -0,0 +1,186 @@
+#ifndef COMPRESS_WAVEFORMDUMP_CXX
+#define COMPRESS_WAVEFORMDUMP_CXX
+
+#include "WaveformDump.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace compress {
+
+  namespace {
+
+    const uint32_t kMagic   = 0x44574E53; // "SNWD"
+    const uint32_t kVersion = 1;
+    const size_t   kHeaderWords = 6;
+
+    template <typename T>
+    void Write(std::ofstream& file, T value)
+    {
+      file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    T Read(const char* data, size_t size, size_t& pos)
+    {
+      if (pos + sizeof(T) > size)
+	throw std::runtime_error("ERROR in WaveformDump: file is truncated.");
+      T value;
+      std::memcpy(&value, data + pos, sizeof(T));
+      pos += sizeof(T);
+      return value;
+    }
+
+  }
+
+  WaveformDumpWriter::WaveformDumpWriter(std::string const& filename)
+    : _file(filename, std::ios::binary), _nchannels(0), _nticks(0), _nframes(0), _nwaveforms(0)
+  {
+    if (!_file)
+      throw std::runtime_error("ERROR in WaveformDumpWriter: cannot open " + filename);
+  }
+
+  WaveformDumpWriter::~WaveformDumpWriter()
+  {
+    if (_file.is_open()) Close();
+  }
+
+  void WaveformDumpWriter::WriteHeader()
+  {
+    _file.seekp(0);
+    Write<uint32_t>(_file, kMagic);
+    Write<uint32_t>(_file, kVersion);
+    Write<uint32_t>(_file, _nchannels);
+    Write<uint32_t>(_file, _nticks);
+    Write<uint32_t>(_file, _nframes);
+    Write<uint32_t>(_file, 0);
+  }
+
+  void WaveformDumpWriter::SetChannels(std::vector<uint32_t> const& channels, std::vector<uint32_t> const& planes,
+				       size_t nticks)
+  {
+    if (_nchannels > 0 || channels.empty() || channels.size() != planes.size())
+      throw std::runtime_error("ERROR in WaveformDumpWriter: invalid channel list.");
+
+    _nchannels = channels.size();
+    _nticks    = nticks;
+    WriteHeader();
+    for (size_t i = 0; i < _nchannels; i++) {
+      Write<uint32_t>(_file, channels[i]);
+      Write<uint32_t>(_file, planes[i]);
+    }
+  }
+
+  void WaveformDumpWriter::AddWaveform(const short* adcs, size_t nticks)
+  {
+    if (nticks != _nticks || _nwaveforms >= _nchannels)
+      throw std::runtime_error("ERROR in WaveformDumpWriter: waveform does not match the channel list.");
+
+    _file.write(reinterpret_cast<const char*>(adcs), nticks * sizeof(short));
+    _nwaveforms += 1;
+  }
+
+  void WaveformDumpWriter::EndFrame(std::vector<SignalDeposit> const& deposits)
+  {
+    if (_nwaveforms != _nchannels)
+      throw std::runtime_error("ERROR in WaveformDumpWriter: frame does not have a waveform for every channel.");
+
+    Write<uint32_t>(_file, deposits.size());
+    for (auto const& dep : deposits) {
+      Write<uint32_t>(_file, dep.index);
+      Write<uint32_t>(_file, dep.tick);
+      Write<float>(_file, dep.electrons);
+    }
+    _nframes += 1;
+    _nwaveforms = 0;
+  }
+
+  void WaveformDumpWriter::Close()
+  {
+    WriteHeader();
+    _file.close();
+  }
+
+  WaveformDump::WaveformDump(std::string const& filename)
+    : _data(nullptr), _size(0), _nticks(0)
+  {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("ERROR in WaveformDump: cannot open " + filename);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      throw std::runtime_error("ERROR in WaveformDump: cannot read " + filename);
+    }
+    _size = st.st_size;
+    void* data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+      throw std::runtime_error("ERROR in WaveformDump: cannot map " + filename);
+    _data = static_cast<const char*>(data);
+    // frames are read in order
+    madvise(data, _size, MADV_SEQUENTIAL);
+
+    size_t pos = 0;
+    uint32_t header[kHeaderWords];
+    for (size_t i = 0; i < kHeaderWords; i++) header[i] = Read<uint32_t>(_data, _size, pos);
+    if (header[0] != kMagic || header[1] != kVersion) {
+      munmap(data, _size);
+      throw std::runtime_error("ERROR in WaveformDump: " + filename + " is not a waveform dump.");
+    }
+    const size_t nchannels = header[2];
+    _nticks = header[3];
+    const size_t nframes = header[4];
+
+    _channels.resize(nchannels);
+    _planes.resize(nchannels);
+    for (size_t i = 0; i < nchannels; i++) {
+      _channels[i] = Read<uint32_t>(_data, _size, pos);
+      _planes[i]   = Read<uint32_t>(_data, _size, pos);
+    }
+
+    // index the frames: only the deposit counts are read
+    const size_t wfbytes = nchannels * _nticks * sizeof(short);
+    _frames.reserve(nframes);
+    for (size_t f = 0; f < nframes; f++) {
+      _frames.push_back(pos);
+      pos += wfbytes;
+      size_t ndeposits = Read<uint32_t>(_data, _size, pos);
+      pos += ndeposits * (2 * sizeof(uint32_t) + sizeof(float));
+      if (pos > _size) {
+	munmap(data, _size);
+	throw std::runtime_error("ERROR in WaveformDump: " + filename + " is truncated.");
+      }
+    }
+  }
+
+  WaveformDump::~WaveformDump()
+  {
+    if (_data) munmap(const_cast<char*>(_data), _size);
+  }
+
+  const short* WaveformDump::Waveform(size_t frame, size_t i) const
+  {
+    return reinterpret_cast<const short*>(_data + _frames[frame] + i * _nticks * sizeof(short));
+  }
+
+  std::vector<SignalDeposit> WaveformDump::Deposits(size_t frame) const
+  {
+    size_t pos = _frames[frame] + _channels.size() * _nticks * sizeof(short);
+    std::vector<SignalDeposit> deposits(Read<uint32_t>(_data, _size, pos));
+    for (auto& dep : deposits) {
+      dep.index     = Read<uint32_t>(_data, _size, pos);
+      dep.tick      = Read<uint32_t>(_data, _size, pos);
+      dep.electrons = Read<float>(_data, _size, pos);
+    }
+    return deposits;
+  }
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ * \file WaveformDump.h
+ *
+ * \ingroup SNCompression
+ * 
+ * \brief Binary dump of raw TPC waveforms (and true signal) to replay the SN-stream compression
+ */
+
+/** \addtogroup SNCompression
+
+    @{*/
+#ifndef COMPRESS_WAVEFORMDUMP_H
+#define COMPRESS_WAVEFORMDUMP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace compress {
+
+  /*
+    Layout of the dump (native byte order):
+
+    header   : 'SNWD', version, number of channels, ticks per waveform, number of frames, 0 (uint32 each)
+    channels : channel number & plane of each waveform of a frame (uint32 each)
+    frames   : the waveforms of all channels (int16 ADCs), then the number of true signal deposits
+               (uint32) followed by the deposits themselves
+  */
+
+  /// True ionization charge reaching waveform index at tick
+  struct SignalDeposit {
+    uint32_t index;
+    uint32_t tick;
+    float    electrons;
+  };
+
+  /// Writes a waveform dump one frame at a time
+  class WaveformDumpWriter {
+
+  public:
+
+    /// Open the dump for writing
+    WaveformDumpWriter(std::string const& filename);
+
+    /// Finalize the dump if not done yet
+    ~WaveformDumpWriter();
+
+    /// Set the channels & planes of the waveforms of every frame (before the first frame)
+    void SetChannels(std::vector<uint32_t> const& channels, std::vector<uint32_t> const& planes, size_t nticks);
+
+    /// Append the waveform of the next channel of the current frame
+    void AddWaveform(const short* adcs, size_t nticks);
+
+    /// Append the true signal of the current frame and close it
+    void EndFrame(std::vector<SignalDeposit> const& deposits);
+
+    /// Write the final header and close the file
+    void Close();
+
+    size_t NChannels() const { return _nchannels; }
+    size_t NTicks()    const { return _nticks; }
+
+  private:
+
+    void WriteHeader();
+
+    std::ofstream _file;
+    size_t _nchannels;
+    size_t _nticks;
+    size_t _nframes;
+    size_t _nwaveforms; // in the current frame
+  };
+
+  /// Read-only view of a waveform dump, mapped in memory
+  class WaveformDump {
+
+  public:
+
+    /// Map the dump in memory and index its frames
+    WaveformDump(std::string const& filename);
+
+    ~WaveformDump();
+
+    WaveformDump(WaveformDump const&) = delete;
+    WaveformDump& operator=(WaveformDump const&) = delete;
+
+    size_t NChannels() const { return _channels.size(); }
+    size_t NTicks()    const { return _nticks; }
+    size_t NFrames()   const { return _frames.size(); }
+
+    uint32_t Channel(size_t i) const { return _channels[i]; }
+    uint32_t Plane(size_t i)   const { return _planes[i]; }
+
+    /// ADCs of waveform i of a frame
+    const short* Waveform(size_t frame, size_t i) const;
+
+    /// True signal of a frame
+    std::vector<SignalDeposit> Deposits(size_t frame) const;
+
+  private:
+
+    const char* _data;
+    size_t _size;
+    size_t _nticks;
+    std::vector<uint32_t> _channels;
+    std::vector<uint32_t> _planes;
+    /// offset of each frame in the file
+    std::vector<size_t> _frames;
+  };
+
+}
+
+#endif
+/** @} */ // end of doxygen group 
@@ -20,26 +20,42 @@
 // services etc...
 #include "larcore/Geometry/WireReadout.h"
 #include "lardata/DetectorInfoServices/DetectorPropertiesService.h"
+#include "lardata/DetectorInfoServices/DetectorClocksService.h"
 
 // data-products
 #include "lardataobj/RawData/RawDigit.h"
+#include "lardataobj/RawData/raw.h"
 #include "lardataobj/RecoBase/Wire.h"
+#include "lardataobj/Simulation/SimChannel.h"
 #include "lardata/Utilities/AssociationUtil.h"
 //#include "lardata/ArtDataHelper/WireCreator.h"
 
 // SN Compression
 #include "ubsim/SNStreamSim/Fmwk/CompressionAlgoBase.h"
 #include "ubsim/SNStreamSim/Algo/AlgorithmFactory.h"
+#include "ubsim/SNStreamSim/Algo/ROIPacking.h"
+#include "ubsim/SNStreamSim/Algo/WaveformDump.h"
 
 // ROOT
 #include "TVector3.h"
 #include <TTree.h>
 #include <TStopwatch.h>
 
+// TBB
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+#include "tbb/enumerable_thread_specific.h"
+
 // C++
 #include <memory>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <string>
 #include <utility>
+#include <unordered_map>
+#include <stdexcept>
+#include <vector>
 
 class ExecuteCompression;
 
@@ -64,6 +80,14 @@ private:
   // debug (verbose) mode?
   bool _debug;
 
+  // producer of the input RawDigits
+  art::InputTag _rawdigit_tag;
+
+  // treat consecutive events as consecutive frames of one continuous stream?
+  bool _stream;
+  // run, subrun & event of the previous frame (to find gaps in the stream)
+  int _prev_run, _prev_subrun, _prev_evt;
+
   // Tree
   TTree* _compress_chch_tree;
   TTree* _compress_evt_tree;
@@ -74,6 +98,31 @@ private:
   double _compressionV;
   double _compressionY;
   int    _evt;
+  // ROI ticks lost (at frame edges)
+  int    _lost;
+  long   _lost_total;
+  // size of the packed ROIs of each plane in this frame [bytes]
+  int    _bytesU, _bytesV, _bytesY;
+
+  // binary file where to write the packed ROIs of every frame (none if empty)
+  std::string _packed_file_name;
+  std::ofstream _packed_file;
+  // unpack every frame and check it against the ROIs saved?
+  bool _verify_packing;
+  // packed frame (reused across events)
+  std::vector<uint16_t> _frame_words;
+  // totals over the job
+  size_t _nframes;
+  double _packed_bytes[3];
+  double _roi_samples;
+
+  // dump of the raw waveforms (and true signal) to replay the compression outside art
+  std::string _dump_file_name;
+  art::InputTag _simchannel_tag;
+  std::unique_ptr<compress::WaveformDumpWriter> _dump;
+  // index in the dump of each channel
+  std::unordered_map<raw::ChannelID_t, uint32_t> _dump_index;
+  std::vector<short> _dump_buffer;
   // Tree for channel-by-channel compression
   double _ch_compression;
   int    _ch;
@@ -81,22 +130,60 @@ private:
   // keep track of number of wires scanned per plane (to calculate compession)
   int _NplU, _NplV, _NplY;
 
-  // timer to keep track of time-performance
-  TStopwatch _evtwatch; // full event time
+  // timer to keep track of time-performance of the (serial) event loop
   TStopwatch _loopwatch;
-  TStopwatch _watch;
-  double _time_loop, _time_get, _time_algo, _time_calc, _time_swap;
+  double _time_loop, _time_calc;
+
+  /// Buffers and time-performance accumulators of each thread working on channels
+  struct ThreadData {
+    /// Buffer holding uncompressed ADCs of compressed RawDigits (reused across channels)
+    std::vector<short> adc_buffer;
+    /// ROIs found on the current channel (reused across channels)
+    std::vector<compress::tick_range> ranges;
+    double time_get  = 0;
+    double time_algo = 0;
+    double time_swap = 0;
+    double time_pack = 0;
+    size_t nchannels = 0;
+  };
+  tbb::enumerable_thread_specific<ThreadData> _thread_data;
+
+  /// Compression output of one RawDigit
+  struct ChannelOutput {
+    lar::sparse_vector<float> rois;
+    raw::ChannelID_t ch = 0;
+    int    pl       = 0;
+    size_t inTicks  = 0;
+    size_t outTicks = 0;
+    size_t lost     = 0;
+    /// channel record in the packed format (empty if no ROI or no packing)
+    std::vector<uint16_t> packed;
+  };
+  /// Output of all RawDigits of the event, in input order
+  std::vector<ChannelOutput> _outputs;
 
   /// Compression Algorithm Object...performs compression
   std::unique_ptr< compress::CompressionAlgoBase > _compress_algo;
 
   geo::WireReadoutGeom const& _channelMapAlg = art::ServiceHandle<geo::WireReadout const>()->Get();
 
-  const std::vector<std::pair< compress::tick, compress::tick> > ApplyCompression(const art::Ptr<raw::RawDigit> rawwf);
-  void CalculateCompression(const std::vector<short> &beforeADCs,
-			    const std::vector<std::pair< compress::tick, compress::tick> > &ranges,
+  /// Access the uncompressed ADCs of a RawDigit without copying when it is not compressed
+  const short* GetADCs(const raw::RawDigit& rawwf, size_t& nticks, std::vector<short>& buffer);
+
+  /// Compress one RawDigit: safe to call concurrently for different channels
+  void ProcessChannel(const raw::RawDigit& rawwf, ThreadData& td, ChannelOutput& out);
+
+  void ApplyCompression(const raw::RawDigit& rawwf, const short* adcs, const size_t nticks,
+			ThreadData& td, ChannelOutput& out);
+  void CalculateCompression(const size_t inTicks, const size_t outTicks,
 			    int pl, int ch);
 
+  /// Unpack the packed frame and check that it holds the ROIs of _outputs
+  void VerifyPacking(const std::vector<uint16_t>& words) const;
+
+  /// Append the waveforms (and true signal) of this frame to the dump
+  void DumpFrame(art::Event const& e, std::vector<raw::RawDigit> const& rawdigits);
+
   void beginJob() override;
   void endJob() override;
     
@@ -116,6 +203,10 @@ void ExecuteCompression::beginJob()
   _compress_evt_tree->Branch("_compressionU",&_compressionU,"compressionU/D");
   _compress_evt_tree->Branch("_compressionV",&_compressionV,"compressionV/D");
   _compress_evt_tree->Branch("_compressionY",&_compressionY,"compressionY/D");
+  _compress_evt_tree->Branch("_lost",&_lost,"lost/I");
+  _compress_evt_tree->Branch("_bytesU",&_bytesU,"bytesU/I");
+  _compress_evt_tree->Branch("_bytesV",&_bytesV,"bytesV/I");
+  _compress_evt_tree->Branch("_bytesY",&_bytesY,"bytesY/I");
 
   _compress_chch_tree = tfs->make<TTree>("_compress_chch_tree","SNCompression channel tree");
   _compress_chch_tree->Branch("_ch_compression",&_ch_compression,"ch_compression/D");
@@ -124,6 +215,22 @@ void ExecuteCompression::beginJob()
 
   _compression = _compressionU = _compressionV = _compressionY = 0;
   _NplU = _NplV = _NplY = 0;
+  _lost = 0;
+  _lost_total = 0;
+  _time_loop = _time_calc = 0;
+  _bytesU = _bytesV = _bytesY = 0;
+  _nframes = 0;
+  _packed_bytes[0] = _packed_bytes[1] = _packed_bytes[2] = 0;
+  _roi_samples = 0;
+
+  if (!_dump_file_name.empty())
+    _dump = std::make_unique<compress::WaveformDumpWriter>(_dump_file_name);
+
+  if (!_packed_file_name.empty()) {
+    _packed_file.open(_packed_file_name, std::ios::binary);
+    if (!_packed_file)
+      throw std::runtime_error("ERROR in ExecuteCompression: cannot open packed output file " + _packed_file_name);
+  }
 
   return;
 }
@@ -131,7 +238,45 @@ void ExecuteCompression::beginJob()
 void ExecuteCompression::endJob()
 {
   
+  mf::LogInfo("ExecuteCompression") << "ROI ticks lost at frame edges: " << _lost_total;
 
+  if (_dump) {
+    _dump->Close();
+    _dump.reset();
+  }
+
+  // sum the time spent by all threads in each step
+  double time_get = 0, time_algo = 0, time_swap = 0, time_pack = 0;
+  size_t nthreads = 0;
+  for (auto const& td : _thread_data) {
+    time_get  += td.time_get;
+    time_algo += td.time_algo;
+    time_swap += td.time_swap;
+    time_pack += td.time_pack;
+    nthreads  += 1;
+  }
+
+  if (_packed_file.is_open()) {
+    _packed_file.close();
+    const double nframes = std::max(_nframes, (size_t)1);
+    const double total   = _packed_bytes[0] + _packed_bytes[1] + _packed_bytes[2];
+    mf::LogInfo("ExecuteCompression") << "Packed ROIs written to " << _packed_file_name << " [bytes/frame]:"
+				      << "\n\t U : " << _packed_bytes[0] / nframes
+				      << "\n\t V : " << _packed_bytes[1] / nframes
+				      << "\n\t Y : " << _packed_bytes[2] / nframes
+				      << "\n\t " << 16. * total / std::max(_roi_samples, 1.) << " bits per ROI sample"
+				      << "\n\t encoding (all thr.): " << 2e-6 * _roi_samples / time_pack << " MB/s of 16-bit ROI samples in, "
+				      << 1e-6 * total / time_pack << " MB/s out";
+  }
+
+  mf::LogInfo("ExecuteCompression") << "Time-performance [s]:"
+				    << "\n\t event loop (wall)   : " << _time_loop
+				    << "\n\t get ADCs (all thr.)  : " << time_get
+				    << "\n\t algorithm (all thr.) : " << time_algo
+				    << "\n\t fill ROIs (all thr.) : " << time_swap
+				    << "\n\t packing (all thr.)   : " << time_pack
+				    << "\n\t compression calc.   : " << _time_calc
+				    << "\n\t threads used        : " << nthreads;
 
 }
 
@@ -144,9 +289,20 @@ ExecuteCompression::ExecuteCompression(fhicl::ParameterSet const & p)
   produces< std::vector< recob::Wire > >();
 
   _debug             = p.get<bool>       ("debug");
+  _rawdigit_tag      = p.get<art::InputTag>("RawDigitLabel", "daq");
+  _stream            = p.get<bool>       ("StreamMode", false);
+  _packed_file_name  = p.get<std::string>("PackedOutputFile", "");
+  _verify_packing    = p.get<bool>       ("VerifyPacking", false);
+  _dump_file_name    = p.get<std::string>("WaveformDumpFile", "");
+  _simchannel_tag    = p.get<art::InputTag>("SimChannelLabel", "");
+
+  _prev_run = _prev_subrun = _prev_evt = -1;
   
   if (_debug) { std::cout << "setting up default compression algo" << std::endl; }
   _compress_algo =  compress::AlgorithmFactory().MakeCompressionAlgo(p);
+  _compress_algo->SetStreaming(_stream);
+  // allocate the state of all channels up front: channels are then processed concurrently
+  _compress_algo->SetNChannels(_channelMapAlg.Nchannels());
   
 }
 
@@ -161,7 +317,7 @@ void ExecuteCompression::produce(art::Event & e)
 
   // load rawdigits
   art::Handle<std::vector<raw::RawDigit> > rawdigit_h;
-  e.getByLabel("daq",rawdigit_h);
+  e.getByLabel(_rawdigit_tag,rawdigit_h);
 
   // make sure rawdigits look good
   if(!rawdigit_h.isValid()) {
@@ -170,56 +326,93 @@ void ExecuteCompression::produce(art::Event & e)
   }
 
 
-  _loopwatch.Start();
+  // the stream can only be continued from the frame right before this one
+  if (_stream) {
+    if ( _prev_evt >= 0 &&
+	 ( (int)e.run() != _prev_run || (int)e.subRun() != _prev_subrun || (int)e.event() != _prev_evt + 1 ) ) {
+      mf::LogWarning("ExecuteCompression") << "Gap in the stream before run " << e.run() << " subrun " << e.subRun()
+					   << " event " << e.event() << ": restarting all channels";
+      _compress_algo->ResetStreams();
+    }
+    _prev_run    = e.run();
+    _prev_subrun = e.subRun();
+    _prev_evt    = e.event();
+  }
 
-  for(size_t h=0; h < rawdigit_h->size(); h++){
+  _evt  = e.event();
+  _lost = 0;
 
-    if (_debug) { std::cout << "new channel" << std::endl; }
+  _loopwatch.Start();
 
-    art::Ptr<raw::RawDigit> rawdigit(rawdigit_h, h);
+  // each channel's firmware state may only be used by one task
+  std::vector<bool> seen(_channelMapAlg.Nchannels(), false);
+  for (auto const& rd : *rawdigit_h) {
+    if (rd.Channel() >= seen.size())
+      throw std::runtime_error("ERROR in ExecuteCompression: RawDigit on unknown channel " + std::to_string(rd.Channel()));
+    if (seen[rd.Channel()])
+      throw std::runtime_error("ERROR in ExecuteCompression: more than one RawDigit on channel " + std::to_string(rd.Channel()));
+    seen[rd.Channel()] = true;
+  }
 
-    if (_debug) { std::cout << "applying compression..." << std::endl; }
-    
-    auto const& ranges = ApplyCompression(rawdigit);
-    
-    auto const& chan = rawdigit->Channel();
+  // compress all channels concurrently: each RawDigit has its own output slot
+  _outputs.clear();
+  _outputs.resize(rawdigit_h->size());
+
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, rawdigit_h->size()),
+		    [&](tbb::blocked_range<size_t> const& r) {
+		      ThreadData& td = _thread_data.local();
+		      for (size_t h = r.begin(); h != r.end(); h++)
+			ProcessChannel((*rawdigit_h)[h], td, _outputs[h]);
+		    });
+
+  // collect the output in input order
+  TStopwatch watch;
+
+  if (_packed_file.is_open()) {
+    size_t nrecords = 0;
+    _bytesU = _bytesV = _bytesY = 0;
+    for (auto const& out : _outputs) {
+      if (out.packed.empty()) continue;
+      nrecords += 1;
+      int bytes = 2 * out.packed.size();
+      if      (out.pl == 0) _bytesU += bytes;
+      else if (out.pl == 1) _bytesV += bytes;
+      else if (out.pl == 2) _bytesY += bytes;
+      _roi_samples += out.outTicks;
+    }
+    _frame_words.clear();
+    compress::PackFrameHeader(e.event(), nrecords, _frame_words);
+    for (auto const& out : _outputs)
+      _frame_words.insert(_frame_words.end(), out.packed.begin(), out.packed.end());
+    _packed_file.write(reinterpret_cast<const char*>(_frame_words.data()), 2 * _frame_words.size());
+    if (_verify_packing) VerifyPacking(_frame_words);
+    _packed_bytes[0] += _bytesU;
+    _packed_bytes[1] += _bytesV;
+    _packed_bytes[2] += _bytesY;
+    _nframes += 1;
+  }
 
-    if (_debug) { std::cout << "\t chan number : " << chan << std::endl; }
-    
-    lar::sparse_vector<float> wf_ROIs;
-    
-    //loop over new waveforms created
-    for (size_t n=0; n < ranges.size(); n++){
-      // prepare output waveform
-      compress::tick t;
-      float first_tick = (float)*(ranges[n].first);
-      std::vector<float> out;
-      for (t = ranges[n].first; t < ranges[n].second; t++)
-	out.push_back( (float)*t - first_tick );
-      
-      unsigned int start_tick = ranges[n].first - _compress_algo->GetInputBegin();
+  if (_dump) DumpFrame(e, *rawdigit_h);
 
-      if (_debug) { std::cout << "\t adding range of size " << out.size() << std::endl; }
-      wf_ROIs.add_range( start_tick, std::move(out) );
-      
-    }// for all saved ROIs
-    
-    _time_swap += _watch.RealTime();
+  for (auto& out : _outputs) {
 
-    if (wf_ROIs.size() == 0) continue;
+    CalculateCompression(out.inTicks, out.outTicks, out.pl, out.ch);
+    _lost += out.lost;
 
-    recob::Wire wire(std::move(wf_ROIs), chan, _channelMapAlg.View(chan) );
+    if (out.rois.size() == 0) continue;
 
     //wire_v->emplace_back( recob::WireCreator(std::move(wf_ROIs),*rawdigit).move() );
     
-    wire_v->emplace_back(wire);
+    wire_v->emplace_back( std::move(out.rois), out.ch, _channelMapAlg.View(out.ch) );
     
   }// for all RawDigit vectors
+  _time_calc += watch.RealTime();
 
   _compressionU /= _NplU;
   _compressionV /= _NplV;
   _compressionY /= _NplY;
   _compression  /= ( _NplU + _NplV + _NplY );
+  _lost_total   += _lost;
   _compress_evt_tree->Fill();
   _NplU = _NplV = _NplY = 0;
   _compressionU = _compressionV = _compressionY = 0;
@@ -230,81 +423,206 @@ void ExecuteCompression::produce(art::Event & e)
   e.put(std::move(wire_v));
 }
 
+// compression of a single RawDigit
+void ExecuteCompression::ProcessChannel(const raw::RawDigit& rawdigit, ThreadData& td, ChannelOutput& out)
+{
+
+  if (_debug) { std::cout << "new channel" << std::endl; }
+
+  TStopwatch watch;
+  size_t nticks = 0;
+  const short* adcs = GetADCs(rawdigit, nticks, td.adc_buffer);
+  td.time_get += watch.RealTime();
+
+  if (_debug) { std::cout << "applying compression..." << std::endl; }
+    
+  ApplyCompression(rawdigit, adcs, nticks, td, out);
+
+  if (_debug) { std::cout << "\t chan number : " << out.ch << std::endl; }
+
+  watch.Start();
+
+  //loop over new waveforms created
+  for (auto const& range : td.ranges){
+    // prepare output waveform
+    float first_tick = (float)adcs[range.first];
+    std::vector<float> roi;
+    roi.reserve(range.second - range.first);
+    for (size_t t = range.first; t < range.second; t++)
+      roi.push_back( (float)adcs[t] - first_tick );
+      
+    if (_debug) { std::cout << "\t adding range of size " << roi.size() << std::endl; }
+    out.rois.add_range( range.first, std::move(roi) );
+      
+  }// for all saved ROIs
+
+  td.time_swap += watch.RealTime();
+
+  // pack the ROIs as they would be sent out
+  if (_packed_file.is_open() && !td.ranges.empty()) {
+    watch.Start();
+    compress::PackChannel(out.ch, adcs, td.ranges, out.packed);
+    td.time_pack += watch.RealTime();
+  }
+
+  td.nchannels += 1;
+}
+
+// waveforms of all channels, in input order, and the true charge on each tick
+void ExecuteCompression::DumpFrame(art::Event const& e, std::vector<raw::RawDigit> const& rawdigits)
+{
+
+  size_t nticks = 0;
+
+  // the first frame fixes the channels in the dump
+  if (_dump->NChannels() == 0) {
+    std::vector<uint32_t> channels, planes;
+    for (size_t h = 0; h < _outputs.size(); h++) {
+      channels.push_back(_outputs[h].ch);
+      planes.push_back(_outputs[h].pl);
+      _dump_index[_outputs[h].ch] = h;
+    }
+    GetADCs(rawdigits.front(), nticks, _dump_buffer);
+    _dump->SetChannels(channels, planes, nticks);
+  }
+
+  if (rawdigits.size() != _dump->NChannels())
+    throw std::runtime_error("ERROR in ExecuteCompression: channels differ from the first frame of the waveform dump.");
+
+  for (size_t h = 0; h < rawdigits.size(); h++) {
+    auto index = _dump_index.find(rawdigits[h].Channel());
+    if (index == _dump_index.end() || index->second != h)
+      throw std::runtime_error("ERROR in ExecuteCompression: channels differ from the first frame of the waveform dump.");
+    const short* adcs = GetADCs(rawdigits[h], nticks, _dump_buffer);
+    _dump->AddWaveform(adcs, nticks);
+  }
+
+  std::vector<compress::SignalDeposit> deposits;
+
+  if (!_simchannel_tag.label().empty()) {
+    auto const& simchannels = *e.getValidHandle<std::vector<sim::SimChannel> >(_simchannel_tag);
+    auto const clockData = art::ServiceHandle<detinfo::DetectorClocksService const>()->DataFor(e);
+    for (auto const& sc : simchannels) {
+      auto index = _dump_index.find(sc.Channel());
+      if (index == _dump_index.end()) continue;
+      for (auto const& timeSlice : sc.TDCIDEMap()) {
+	// same tick as in SimWireMicroBooNE
+	int tick = clockData.TPCTDC2Tick(timeSlice.first) + 1;
+	if (tick < 0 || tick >= (int)_dump->NTicks()) continue;
+	float electrons = 0;
+	for (auto const& ide : timeSlice.second) electrons += ide.numElectrons;
+	deposits.push_back({ index->second, (uint32_t)tick, electrons });
+      }
+    }
+  }
+
+  _dump->EndFrame(deposits);
+}
+
+// round trip of the packed frame: every ROI must be read back as saved in the Wires
+void ExecuteCompression::VerifyPacking(const std::vector<uint16_t>& words) const
+{
+
+  uint32_t frame = 0;
+  std::vector<compress::PackedROI> rois;
+  size_t used = compress::UnpackFrame(words.data(), words.size(), frame, rois);
+  if (used != words.size())
+    throw std::runtime_error("ERROR in ExecuteCompression: packed frame has trailing words.");
+
+  size_t iroi = 0;
+  for (auto const& out : _outputs) {
+    if (out.packed.empty()) continue;
+    size_t ticks = 0;
+    while (iroi < rois.size() && rois[iroi].channel == out.ch) {
+      auto const& roi = rois[iroi++];
+      for (size_t t = 0; t < roi.adcs.size(); t++) {
+	if (out.rois[roi.start + t] != (float)roi.adcs[t] - (float)roi.adcs[0])
+	  throw std::runtime_error("ERROR in ExecuteCompression: packed ROI differs from the one saved on channel "
+				   + std::to_string(out.ch));
+      }
+      ticks += roi.adcs.size();
+    }
+    if (ticks != out.outTicks)
+      throw std::runtime_error("ERROR in ExecuteCompression: packed ROIs missing on channel " + std::to_string(out.ch));
+  }
+  if (iroi != rois.size())
+    throw std::runtime_error("ERROR in ExecuteCompression: unexpected ROIs in packed frame.");
+}
+
+// uncompressed ADCs: in place if not compressed, else decompressed into a reused buffer
+const short* ExecuteCompression::GetADCs(const raw::RawDigit& rawwf, size_t& nticks, std::vector<short>& buffer)
+{
+
+  if (rawwf.Compression() == raw::kNone) {
+    nticks = rawwf.ADCs().size();
+    return rawwf.ADCs().data();
+  }
+
+  buffer.resize(rawwf.Samples());
+  raw::Uncompress(rawwf.ADCs(), buffer, rawwf.GetPedestal(), rawwf.Compression());
+  nticks = buffer.size();
+  return buffer.data();
+}
+
 // function where compression is applied on a single wf
-const std::vector<std::pair< compress::tick, compress::tick> > ExecuteCompression::ApplyCompression(const art::Ptr<raw::RawDigit> rawwf)
+void ExecuteCompression::ApplyCompression(const raw::RawDigit& rawwf, const short* adcs, const size_t nticks,
+					  ThreadData& td, ChannelOutput& out)
 {
   
   //Check for empty waveforms!
-  if(rawwf->ADCs().size()<1){
-    std::cout << "Found 0-length waveform: Ch. " << rawwf->Channel() << std::endl;
+  if(nticks<1){
+    std::cout << "Found 0-length waveform: Ch. " << rawwf.Channel() << std::endl;
   }//if wf size < 1
 
-  auto const& ch   = rawwf->Channel();
+  auto const& ch   = rawwf.Channel();
   auto const& wids = _channelMapAlg.ChannelToWire(ch);
   auto const& pl   = wids[0].Plane;
 
+  out.ch = ch;
+  out.pl = pl;
+
   // finally, apply compression:
   // *-------------------------*
-  // 1) Convert tpc_data object to just the vector of shorts which make up the ADC ticks
-  _watch.Start();
-  const std::vector<short> ADCwaveformL = rawwf->ADCs();
-  // cut size so that 3 blocks fit perfectly
-  int nblocks = ADCwaveformL.size()/(3*64);
-  std::vector<short>::const_iterator first = ADCwaveformL.begin();
-  std::vector<short>::const_iterator last  = ADCwaveformL.begin()+(3*64*nblocks);
-  std::vector<short> ADCwaveform(first,last);
-  _time_get += _watch.RealTime();
+  // 1) cut size so that 3 blocks fit perfectly
+  //    (in streaming mode blocks run across frames: use the whole frame)
+  int nblocks = nticks/(3*64);
+  const size_t nticks_used = ( _stream ? nticks : 3*64*nblocks );
   // 2) Now apply the compression algorithm. _compress_algo is an instance of CompressionAlgoBase
-  _watch.Start();
-  if (_debug) { std::cout << "\t applying algo-specific compression to waveform of size " << ADCwaveform.size() << " and 1st entry " << ADCwaveform.at(0) << "\t Nblocks : " << nblocks << std::endl; }
-  _compress_algo->ApplyCompression(ADCwaveform,pl,ch);
-  _time_algo += _watch.RealTime();
-  // 3) Retrieve output ranges saved
-  if (_debug) { std::cout << "\t getting output ranges" << std::endl; }
-  auto const& ranges = _compress_algo->GetOutputRanges();
-  if (_debug) { std::cout << "\t found " << ranges.size() << " ranges" << std::endl; }
-  // 6) Study the Compression results for this channel
-  _watch.Start();
-  // 9) Calculate compression factor [ for now Ticks After / Ticks Before ]
-  _watch.Start();
-  if (_debug) { std::cout << "\t calculate compression" << std::endl; }
-  CalculateCompression(ADCwaveform, ranges, pl, ch);
-  _time_calc += _watch.RealTime();
-  // 10) clear _InWF and _OutWF from compression algo object -> resetting algorithm for next time it is called
-  _compress_algo->Reset();
-  // return ranges
-  return ranges;
+  TStopwatch watch;
+  if (_debug) { std::cout << "\t applying algo-specific compression to waveform of size " << nticks_used << " and 1st entry " << adcs[0] << "\t Nblocks : " << nblocks << std::endl; }
+  out.lost = _compress_algo->ApplyCompression(adcs,nticks_used,pl,ch,td.ranges);
+  td.time_algo += watch.RealTime();
+  // 3) Output ranges are held by the caller
+  if (_debug) { std::cout << "\t found " << td.ranges.size() << " ranges" << std::endl; }
+  // 4) Count ticks saved, to calculate the compression factor [ for now Ticks After / Ticks Before ]
+  out.inTicks  = nticks_used;
+  out.outTicks = 0;
+  for (auto const& range : td.ranges)
+    out.outTicks += range.second - range.first;
 }
  
 
-void ExecuteCompression::CalculateCompression(const std::vector<short> &beforeADCs,
-					      const std::vector<std::pair< compress::tick, compress::tick> > &ranges,
+void ExecuteCompression::CalculateCompression(const size_t inTicks, const size_t outTicks,
 					      int pl, int ch){
   
-  double inTicks = beforeADCs.size();
-  double outTicks = 0;
-  
-  for (size_t n=0; n < ranges.size(); n++)
-    outTicks += (ranges[n].second-ranges[n].first);
-  
   if (pl==0){
-    _compressionU += outTicks/inTicks;
+    _compressionU += (double)outTicks/inTicks;
     _NplU += 1;
   }
   else if (pl==1){
-    _compressionV += outTicks/inTicks;
+    _compressionV += (double)outTicks/inTicks;
     _NplV += 1;
   }
   else if (pl==2){
-    _compressionY += outTicks/inTicks;
+    _compressionY += (double)outTicks/inTicks;
     _NplY += 1;
   }
   else
     std::cout << "What plane? Error?" << std::endl;
   
-  _ch_compression = outTicks/inTicks;
+  _ch_compression = (double)outTicks/inTicks;
   
-  _compression += outTicks/inTicks;
+  _compression += (double)outTicks/inTicks;
   
   _ch = ch;
   _pl = pl;
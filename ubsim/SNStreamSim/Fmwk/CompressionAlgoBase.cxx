@@ -8,13 +8,17 @@ namespace compress {
   CompressionAlgoBase::CompressionAlgoBase(){
 
     _verbose = false; 
+    _debug   = false;
+    _streaming  = false;
   }
 
   CompressionAlgoBase::CompressionAlgoBase(fhicl::ParameterSet  const &pset){
     CompressionAlgoBase();
   }
   
-  void CompressionAlgoBase::ApplyCompression(const std::vector<short> &waveform, int mode, const unsigned int ch){
+  size_t CompressionAlgoBase::ApplyCompression(const short* waveform, const size_t nticks,
+					       const int mode, const unsigned int ch,
+					       std::vector<compress::tick_range>& ranges){
 
     if (_verbose) { std::cout << "Exploring plane " << mode << std::endl; }
 
@@ -28,12 +32,11 @@ namespace compress {
     // in the old waveform at which the new waveform starts
     //_OutWFStartTick.push_back(0);
 
-    // make a pair that contains the entire vector
-    _timeRange.push_back(std::make_pair(waveform.begin(),waveform.end()));
-    _begin = waveform.begin();
-    _end   = waveform.end();
+    // make a pair that contains the entire waveform
+    ranges.clear();
+    ranges.push_back(std::make_pair((size_t)0,nticks));
 
-    return;
+    return 0;
   }
   
 }
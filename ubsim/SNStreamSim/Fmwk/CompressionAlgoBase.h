@@ -12,6 +12,7 @@
 
 #include <iostream>
 #include <vector>
+#include <cstddef>
 #include <utility> // for pair
 
 // Art Framework
@@ -19,7 +20,8 @@
 
 namespace compress {
 
-  typedef std::vector<short>::const_iterator tick;
+  /// Region Of Interest saved by compression: [first,second) tick offsets into the input waveform
+  typedef std::pair<size_t,size_t> tick_range;
 
   /**
      \class CMAlgoBase
@@ -39,14 +41,24 @@ namespace compress {
     virtual ~CompressionAlgoBase(){}
 
     /// Function to reset the algorithm instance 
-    virtual void Reset() { _InWF.clear(); _timeRange.clear(); }
+    virtual void Reset() { _baselines.clear(); _variances.clear(); }
+
+    /**
+       Function where compression is performed. The waveform is read in place (nticks samples
+       starting at waveform) and the ROIs found are written to the caller-owned ranges vector
+       (cleared first) as tick offsets w.r.t. the start of the waveform. Returns the number of
+       ROI ticks found that could not be saved (e.g. cut at a frame edge).
+       Per-channel state is kept in a dense array indexed by channel and sized by SetNChannels,
+       which must cover every channel passed here. Calls for different channels may then run
+       concurrently; a channel must never be processed by two concurrent calls.
+    */
+    virtual size_t ApplyCompression(const short* waveform, const size_t nticks,
+				    const int mode, const unsigned int ch,
+				    std::vector<compress::tick_range>& ranges);
+
+    /// Allocate the per-channel state of channels [0, nchannels)
+    virtual void SetNChannels(size_t) {}
 
-    /// Function where compression is performed
-    virtual void ApplyCompression(const std::vector<short> &waveform, const int mode, const unsigned int ch);
-
-    /// Get range of output waveforms
-    virtual const std::vector<std::pair< compress::tick, compress::tick> > GetOutputRanges() { return _timeRange; }
-    
     /// Setter function for verbosity
     virtual void SetVerbose(bool doit=true) { _verbose = doit; }
 
@@ -59,10 +71,15 @@ namespace compress {
     /// Get Variances vector
     virtual const std::vector<double> GetVariances() { return _variances; }
 
-    /// Get iterator to beginning of input WF
-    virtual const tick GetInputBegin() { return _begin; }
-    /// Get iterator to end of input WF
-    virtual const tick GetInputEnd() { return _end; }
+    /**
+       Setter function for streaming mode: consecutive calls for the same channel are
+       consecutive frames of one continuous stream, and the algorithm carries its
+       per-channel state (and any open ROI) from one frame to the next.
+    */
+    virtual void SetStreaming(bool doit=true) { _streaming = doit; }
+
+    /// Forget all per-channel stream state (e.g. at a gap between frames)
+    virtual void ResetStreams() {}
 
 
   protected:
@@ -73,17 +90,8 @@ namespace compress {
     /// Boolean to choose debug mode.
     bool _debug;
 
-    /// Waveform read in by algorithm...to be scanned and compressed
-    std::vector<short> _InWF;
-
-    /// vector of pairs of iterators marking the beginning/end of the segment to be saved
-    std::vector<std::pair< compress::tick, compress::tick> > _timeRange;
-    /// iterator pointing to current tick
-    tick _thisTick;
-    /// iterator pointing to beginning of input wf
-    tick _begin;
-    /// iterator pointing to end of input wf
-    tick _end;
+    /// Boolean to choose streaming mode.
+    bool _streaming;
 
     /// Vector where to hold the various baselines for the various blocks
     std::vector<double> _baselines;
@@ -96,4 +104,3 @@ namespace compress {
 
 #endif
 /** @} */ // end of doxygen group 
-
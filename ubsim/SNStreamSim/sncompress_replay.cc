@@ -0,0 +1,311 @@
+////////////////////////////////////////////////////////////////////////
+// Program:     sncompress_replay
+// File:        sncompress_replay.cc
+//
+// Replays the SN-stream compression outside art on a dump of raw
+// waveforms (written by ExecuteCompression with WaveformDumpFile set),
+// for every point of a grid of algorithm settings, and prints the
+// compression, ROI count, packed data volume and signal efficiency of
+// each point.
+//
+// usage: sncompress_replay -c <config.fcl> [-o <table.csv>] <dump>
+//
+// The configuration holds a table "replay" with the algorithm settings
+// (as given to ExecuteCompression), optionally a list of explicit points
+// applied on top of them, and the values to scan on top of each point:
+//
+//   replay : {
+//     Algorithm : @local::AdaptiveThreshold
+//     Points    : [ { CompressionAlgoName : "MicrobooneFirmware" },
+//                   { CompressionAlgoName : "AdaptiveThreshold" } ]
+//     Grid      : { CompressThresholds : [ [-25,15,30], [-20,12,25] ]
+//                   BaselineThreshold  : [ 2, 3 ] }
+//   }
+////////////////////////////////////////////////////////////////////////
+
+#include "cetlib/filepath_maker.h"
+#include "fhiclcpp/ParameterSet.h"
+
+#include "ubsim/SNStreamSim/Fmwk/CompressionAlgoBase.h"
+#include "ubsim/SNStreamSim/Algo/AlgorithmFactory.h"
+#include "ubsim/SNStreamSim/Algo/WaveformDump.h"
+#include "ubsim/SNStreamSim/Algo/ROIPacking.h"
+
+#include "tbb/parallel_for.h"
+#include "tbb/blocked_range.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+  // settings that can be scanned, by type
+  const std::vector<std::string> kListSettings     = { "CompressThresholds", "Polarity", "PlaneBuffers" };
+  const std::vector<std::string> kScalarSettings   = { "BaselineThreshold", "VarianceThreshold", "MaxADC" };
+  const std::vector<std::string> kRealListSettings = { "NSigma", "MinThresholds" };
+  const std::vector<std::string> kStringSettings   = { "CompressionAlgoName" };
+
+  bool IsIn(std::vector<std::string> const& names, std::string const& name)
+  {
+    return (std::find(names.begin(), names.end(), name) != names.end());
+  }
+
+  /// One set of algorithm settings
+  struct GridPoint {
+    fhicl::ParameterSet pset;
+    std::string label;
+  };
+
+  /// Totals over all frames for the channels of one plane
+  struct PlaneSummary {
+    double inTicks  = 0;
+    double outTicks = 0;
+    double nroi     = 0;
+    double charge   = 0;
+    double kept     = 0;
+    double bytes    = 0;
+  };
+
+  struct PointResult {
+    PlaneSummary planes[3];
+    double seconds = 0;
+  };
+
+  template <typename T>
+  std::string ToString(T const& value)
+  {
+    std::ostringstream out;
+    out << value;
+    return out.str();
+  }
+
+  template <typename T>
+  std::string ToString(std::vector<T> const& v)
+  {
+    std::ostringstream out;
+    out << "[";
+    for (size_t i = 0; i < v.size(); i++) out << (i ? "," : "") << v[i];
+    out << "]";
+    return out.str();
+  }
+
+  /// Point with setting name set to value
+  template <typename T>
+  GridPoint Override(GridPoint point, std::string const& name, T const& value)
+  {
+    point.pset.put_or_replace(name, value);
+    point.label += (point.label.empty() ? "" : " ") + name + "=" + ToString(value);
+    return point;
+  }
+
+  /**
+     Points with setting name set to each of its values in table: if alternatives is true the
+     table holds a list of values to scan, otherwise the one value to set
+  */
+  std::vector<GridPoint> Override(std::vector<GridPoint> const& points, std::string const& name,
+				  fhicl::ParameterSet const& table, bool alternatives)
+  {
+    std::vector<GridPoint> next;
+
+    auto apply = [&](auto tag) {
+      typedef decltype(tag) T;
+      for (auto const& point : points) {
+	if (alternatives)
+	  for (auto const& value : table.get<std::vector<T> >(name)) next.push_back(Override(point, name, value));
+	else
+	  next.push_back(Override(point, name, table.get<T>(name)));
+      }
+    };
+
+    if      (IsIn(kListSettings, name))     apply(std::vector<int>());
+    else if (IsIn(kScalarSettings, name))   apply(int());
+    else if (IsIn(kRealListSettings, name)) apply(std::vector<double>());
+    else if (IsIn(kStringSettings, name))   apply(std::string());
+    else
+      throw std::runtime_error("ERROR in sncompress_replay: setting " + name + " cannot be scanned.");
+
+    return next;
+  }
+
+  /// The explicit points (or the base settings), each with all combinations of the values in grid
+  std::vector<GridPoint> MakeGrid(fhicl::ParameterSet const& base, std::vector<fhicl::ParameterSet> const& explicit_points,
+				  fhicl::ParameterSet const& grid)
+  {
+    std::vector<GridPoint> points;
+
+    if (explicit_points.empty()) points.push_back(GridPoint{ base, "" });
+    for (auto const& table : explicit_points) {
+      std::vector<GridPoint> point(1, GridPoint{ base, "" });
+      for (auto const& name : table.get_names()) point = Override(point, name, table, false);
+      points.push_back(point.front());
+    }
+
+    for (auto const& name : grid.get_names()) points = Override(points, name, grid, true);
+
+    return points;
+  }
+
+  bool InRanges(std::vector<compress::tick_range> const& ranges, size_t tick)
+  {
+    // ranges are sorted and do not overlap
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), tick,
+			       [](size_t t, compress::tick_range const& r) { return t < r.first; });
+    return (it != ranges.begin() && tick < (it - 1)->second);
+  }
+
+  /// Run the algorithm over all frames of the dump
+  PointResult Replay(compress::CompressionAlgoBase& algo, bool stream, compress::WaveformDump const& dump)
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    PointResult result;
+
+    const size_t nchannels = dump.NChannels();
+    uint32_t maxch = 0;
+    for (size_t i = 0; i < nchannels; i++) maxch = std::max(maxch, dump.Channel(i));
+    algo.SetStreaming(stream);
+    algo.SetNChannels(maxch + 1);
+
+    // each channel's firmware state may only be used by one task
+    std::vector<bool> seen(maxch + 1, false);
+    for (size_t i = 0; i < nchannels; i++) {
+      if (seen[dump.Channel(i)])
+	throw std::runtime_error("ERROR in sncompress_replay: more than one waveform on channel " + std::to_string(dump.Channel(i)));
+      seen[dump.Channel(i)] = true;
+    }
+
+    // same length as in ExecuteCompression
+    const size_t nticks = ( stream ? dump.NTicks() : 3*64*(dump.NTicks()/(3*64)) );
+
+    std::vector<std::vector<compress::tick_range> > ranges(nchannels);
+    // size of each channel in the packed format
+    std::vector<size_t> words(nchannels);
+
+    for (size_t f = 0; f < dump.NFrames(); f++) {
+
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, nchannels),
+			[&](tbb::blocked_range<size_t> const& r) {
+			  thread_local std::vector<uint16_t> packed;
+			  for (size_t i = r.begin(); i != r.end(); i++) {
+			    algo.ApplyCompression(dump.Waveform(f, i), nticks, dump.Plane(i), dump.Channel(i), ranges[i]);
+			    packed.clear();
+			    if (!ranges[i].empty()) compress::PackChannel(dump.Channel(i), dump.Waveform(f, i), ranges[i], packed);
+			    words[i] = packed.size();
+			  }
+			});
+
+      for (size_t i = 0; i < nchannels; i++) {
+	auto& plane = result.planes[std::min(dump.Plane(i), 2u)];
+	plane.inTicks += nticks;
+	plane.nroi    += ranges[i].size();
+	plane.bytes   += 2 * words[i];
+	for (auto const& range : ranges[i]) plane.outTicks += range.second - range.first;
+      }
+
+      for (auto const& dep : dump.Deposits(f)) {
+	if (dep.tick >= nticks) continue;
+	auto& plane = result.planes[std::min(dump.Plane(dep.index), 2u)];
+	plane.charge += dep.electrons;
+	if (InRanges(ranges[dep.index], dep.tick)) plane.kept += dep.electrons;
+      }
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return result;
+  }
+
+  void Usage()
+  {
+    std::cerr << "usage: sncompress_replay -c <config.fcl> [-o <table.csv>] <dump>" << std::endl;
+  }
+
+}
+
+int main(int argc, char** argv)
+{
+
+  std::string config, table, dumpfile;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if      (arg == "-c" && i + 1 < argc) config = argv[++i];
+    else if (arg == "-o" && i + 1 < argc) table  = argv[++i];
+    else if (arg == "-h" || arg == "--help") { Usage(); return 0; }
+    else if (dumpfile.empty()) dumpfile = arg;
+    else { Usage(); return 1; }
+  }
+  if (config.empty() || dumpfile.empty()) { Usage(); return 1; }
+
+  try {
+
+    cet::filepath_lookup policy("FHICL_FILE_PATH");
+    auto const replay = fhicl::ParameterSet::make(config, policy).get<fhicl::ParameterSet>("replay");
+    auto const base   = replay.get<fhicl::ParameterSet>("Algorithm");
+    auto const grid   = replay.get<fhicl::ParameterSet>("Grid", fhicl::ParameterSet());
+    auto const explicit_points = replay.get<std::vector<fhicl::ParameterSet> >("Points", std::vector<fhicl::ParameterSet>());
+    const bool stream = base.get<bool>("StreamMode", false);
+
+    compress::WaveformDump dump(dumpfile);
+    std::cout << "Replaying " << dump.NFrames() << " frames of " << dump.NChannels() << " channels x "
+	      << dump.NTicks() << " ticks" << (stream ? " as one stream" : "") << std::endl;
+
+    auto points = MakeGrid(base, explicit_points, grid);
+
+    // one algorithm instance per point, all made up front
+    std::vector<std::unique_ptr<compress::CompressionAlgoBase> > algos;
+    for (auto const& point : points)
+      algos.push_back(compress::AlgorithmFactory().MakeCompressionAlgo(point.pset));
+
+    std::vector<PointResult> results(points.size());
+    tbb::parallel_for(size_t(0), points.size(), [&](size_t n) {
+	results[n] = Replay(*algos[n], stream, dump);
+      });
+
+    FILE* csv = nullptr;
+    if (!table.empty()) {
+      csv = fopen(table.c_str(), "w");
+      if (!csv) throw std::runtime_error("ERROR in sncompress_replay: cannot open " + table);
+      fprintf(csv, "point,settings,ratioU,ratioV,ratioY,roisU,roisV,roisY,kBU,kBV,kBY,effU,effV,effY,ms_per_frame\n");
+    }
+
+    const double nframes = std::max(dump.NFrames(), (size_t)1);
+    printf("\n%5s  %-8s %-8s %-8s  %-9s %-9s %-9s  %-8s %-8s %-8s  %-6s %-6s %-6s  %-9s  %s\n",
+	   "point", "ratio U", "ratio V", "ratio Y", "ROIs/fr U", "ROIs/fr V", "ROIs/fr Y",
+	   "kB/fr U", "kB/fr V", "kB/fr Y", "eff U", "eff V", "eff Y", "ms/frame", "settings");
+    for (size_t n = 0; n < points.size(); n++) {
+      auto const& r = results[n];
+      double ratio[3], rois[3], kB[3], eff[3];
+      for (size_t pl = 0; pl < 3; pl++) {
+	auto const& p = r.planes[pl];
+	ratio[pl] = ( p.inTicks > 0 ? p.outTicks / p.inTicks : 0 );
+	rois[pl]  = p.nroi / nframes;
+	kB[pl]    = 1e-3 * p.bytes / nframes;
+	// no true signal: efficiency not available
+	eff[pl]   = ( p.charge > 0 ? p.kept / p.charge : -1 );
+      }
+      const double ms = 1e3 * r.seconds / nframes;
+      printf("%5zu  %-8.5f %-8.5f %-8.5f  %-9.1f %-9.1f %-9.1f  %-8.1f %-8.1f %-8.1f  %-6.3f %-6.3f %-6.3f  %-9.2f  %s\n",
+	     n, ratio[0], ratio[1], ratio[2], rois[0], rois[1], rois[2], kB[0], kB[1], kB[2],
+	     eff[0], eff[1], eff[2], ms, points[n].label.c_str());
+      if (csv)
+	fprintf(csv, "%zu,\"%s\",%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g,%g\n", n, points[n].label.c_str(),
+		ratio[0], ratio[1], ratio[2], rois[0], rois[1], rois[2], kB[0], kB[1], kB[2],
+		eff[0], eff[1], eff[2], ms);
+    }
+    if (csv) fclose(csv);
+
+  }
+  catch (std::exception const& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}